@@ -1,12 +1,20 @@
 
 #include "aligner.h"
+#include <algorithm>
+#include <cassert>
 #include <cfloat>
+#include <climits>
 #include <fstream>
+#include <immintrin.h>
 #include <iostream>
 #include <vector>
 //#include "agd/agd_dataset.h"
 #include "debug.h"
+#include "pair_cache.h"
 extern "C" {
+#include "swps3/DynProgr_avx_double.h"
+#include "swps3/DynProgr_global_double.h"
+#include "swps3/DynProgr_multi_double.h"
 #include "swps3/DynProgr_sse_double.h"
 #include "swps3/DynProgr_sse_short.h"
 #include "swps3/extras.h"
@@ -14,6 +22,69 @@ extern "C" {
 
 using namespace std;
 
+namespace {
+
+enum class DoubleKernel { SSE2, AVX2, AVX512F };
+
+DoubleKernel DetectDoubleKernel() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    return DoubleKernel::AVX512F;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return DoubleKernel::AVX2;
+  }
+  return DoubleKernel::SSE2;
+}
+
+const DoubleKernel double_kernel = DetectDoubleKernel();
+
+// env class the PassesThreshold results are cached under. they are the
+// LogPamPassesThreshold results when the just score env is the logpam one
+// and the ungapped stage rejects nothing on its own
+PairCache::Kind ThresholdKind(const Parameters& params) {
+  if (params.use_blosum || params.ungapped_reject_fraction > 0) {
+    return PairCache::Kind::kThreshold;
+  }
+  return PairCache::Kind::kLogPamThreshold;
+}
+
+// L1 distance of the amino acid compositions of a and b
+float CompositionDistance(const Sequence& a, const Sequence& b) {
+  static_assert(Sequence::kCompositionSize % 4 == 0, "whole SSE vectors");
+  const float* x = a.Composition();
+  const float* y = b.Composition();
+  const __m128 sign = _mm_set1_ps(-0.0f);
+  __m128 sum = _mm_setzero_ps();
+  for (int i = 0; i < Sequence::kCompositionSize; i += 4) {
+    __m128 diff = _mm_sub_ps(_mm_load_ps(x + i), _mm_load_ps(y + i));
+    sum = _mm_add_ps(sum, _mm_andnot_ps(sign, diff));
+  }
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+  return _mm_cvtss_f32(sum);
+}
+
+// the traceback kernel keeps half a byte (AVX-512) to two bytes (SSE2) per
+// cell, longer pairs go through the linear space AlignStrings
+const size_t kGlobalTracebackMaxCells = 1 << 24;
+
+// up to about this many cells, one sweep with an env per lane beats aligning
+// once per env with the striped kernel. the per column overhead of the
+// striped kernel dominates for short sequences
+const long kMultiEnvMaxCells = 300 * 300;
+
+const int kMultiEnvLanes = 8;
+
+// float_start_point redoes in double the envs whose estimated pam from the
+// float alignment is this close to the best one. only the local region
+// comes from float, the global alignment and EstimPam over it are double,
+// so a near tie in the local scores has to move an end of the region to
+// change the estimate at all. that never happened on our test sets
+const double kFloatPamTolerance = 0.25;
+
+}  // namespace
+
 char* denormalize(const char* str, int len) {
   auto ret = new char[(len + 1) * sizeof(char)];
   int i;
@@ -67,72 +138,503 @@ void debug_profile(char* name, void* pb, const char* q, int queryLen,
   free(query);
 }
 
+const char* ProteinAligner::ShortKernelName() { return Profile::KernelName(); }
+
+agd::Status ProteinAligner::TuneShortKernels(const AlignmentEnvironments& envs,
+                                             const std::string& tuning_file) {
+  return Profile::TuneKernels(envs.JustScoreEnv(), tuning_file);
+}
+
+std::string ProteinAligner::ShortKernelTable() {
+  return Profile::KernelTable();
+}
+
+const char* ProteinAligner::DoubleKernelName() {
+  switch (double_kernel) {
+    case DoubleKernel::AVX512F:
+      return "AVX-512F (8 x double)";
+    case DoubleKernel::AVX2:
+      return "AVX2 (4 x double)";
+    default:
+      return "SSE2 (2 x double)";
+  }
+}
+
 const double ProteinAligner::pam_list_[] = {35,  49,  71,  98,  115, 133,
                                             152, 174, 200, 229, 262, 300};
 
-void ProteinAligner::FindStartingPoint(const char* seq1, const char* seq2,
-                                       int seq1_len, int seq2_len,
-                                       StartPoint& point) {
-  if (!buf1_) {
-    // assuming that one big alloc is more efficient
-    buf1_ = new char[MAXSEQLEN * 4];
-    buf2_ = buf1_ + MAXSEQLEN;
-    savebuf1_ = buf2_ + MAXSEQLEN;
-    savebuf2_ = savebuf1_ + MAXSEQLEN;
+int ProteinAligner::FindEnvAlignment(const AlignmentEnvironment& env) {
+  for (size_t i = 0; i < num_env_alignments_; i++) {
+    if (env_alignments_[i].alignment.env == &env) return i;
   }
+  return -1;
+}
 
-  double starting_pam = -1e10;
-  agd::Status s;
-  Alignment alignment;
+size_t ProteinAligner::AddEnvAlignment(const Alignment& alignment,
+                                       int max_len) {
+  if (num_env_alignments_ == env_alignments_.size()) {
+    env_alignments_.emplace_back();
+  }
+  SetEnvAlignment(num_env_alignments_, alignment, max_len);
+  return num_env_alignments_++;
+}
+
+void ProteinAligner::SetEnvAlignment(size_t index, const Alignment& alignment,
+                                     int max_len) {
   double estim_result[3];
+  envs_->EstimPam(buf1_, buf2_, max_len, estim_result, &pam_scratch_);
+  // LOG(INFO) << "AlignEnv: estim pam values: " << estim_result[0] << ", " <<
+  // estim_result[1]
+  //<< ", " << estim_result[2] << " str max len = " << max_len;
+
+  auto& result = env_alignments_[index];
+  result.alignment = alignment;
+  result.alignment.pam_distance = estim_result[1];
+  result.alignment.pam_variance = estim_result[2];
+  result.estimated_pam = estim_result[0];
+  result.len = max_len;
+  result.seq1.assign(buf1_, buf1_ + max_len);
+  result.seq2.assign(buf2_, buf2_ + max_len);
+  result.approx = false;
+}
+
+int ProteinAligner::AlignRegion(const char* seq1, const char* seq2,
+                                const Alignment& alignment) {
+  char* s1 = const_cast<char*>(seq1) + alignment.seq1_min;
+  char* s2 = const_cast<char*>(seq2) + alignment.seq2_min;
+  int s1_len = alignment.seq1_max - alignment.seq1_min + 1;  //  ?
+  int s2_len = alignment.seq2_max - alignment.seq2_min + 1;  //  ?
+
+  return AlignGlobal(*alignment.env, s1, s1_len, s2, s2_len, alignment.score,
+                     buf1_, buf2_);
+}
+
+size_t ProteinAligner::AlignEnv(const char* seq1, const char* seq2,
+                                int seq1_len, int seq2_len,
+                                const AlignmentEnvironment& env,
+                                const Alignment* local) {
+  int found = FindEnvAlignment(env);
+  if (found >= 0) return found;
+
+  Alignment alignment;
+  if (local) {
+    alignment = *local;
+  } else {
+    AlignDouble(seq1, seq2, seq1_len, seq2_len, false, alignment, env);
+  }
+  // LOG(INFO) << "AlignEnv align double score is " << alignment.score;
+
+  return AddEnvAlignment(alignment, AlignRegion(seq1, seq2, alignment));
+}
+
+size_t ProteinAligner::AlignEnvApprox(const char* seq1, const char* seq2,
+                                      int seq1_len, int seq2_len,
+                                      const AlignmentEnvironment& env) {
+  int found = FindEnvAlignment(env);
+  if (found >= 0) return found;
+
+  // same conditions as the wide AlignDouble kernels
+  Alignment local;
+  int max1, max2, min1, min2;
+  if (!params_->float_start_point || double_kernel == DoubleKernel::SSE2 ||
+      env.gap_open > env.gap_extend ||
+      !AlignLocalFloat(&float_scratch_, double_kernel == DoubleKernel::AVX512F,
+                       env, seq1, seq1_len, seq2, seq2_len, &local.score,
+                       &max1, &max2, &min1, &min2)) {
+    return AlignEnv(seq1, seq2, seq1_len, seq2_len, env);
+  }
+  local.env = &env;
+  local.seq1_max = max1 - 1;
+  local.seq2_max = max2 - 1;
+  local.seq1_min = min1 - 1;
+  local.seq2_min = min2 - 1;
+
+  size_t index = AlignEnv(seq1, seq2, seq1_len, seq2_len, env, &local);
+  env_alignments_[index].approx = true;
+  return index;
+}
+
+size_t ProteinAligner::ExactEnvAlignment(const char* seq1, const char* seq2,
+                                         int seq1_len, int seq2_len,
+                                         size_t index) {
+  auto& env_alignment = env_alignments_[index];
+  if (!env_alignment.approx) return index;
+
+  Alignment alignment;
+  AlignDouble(seq1, seq2, seq1_len, seq2_len, false, alignment,
+              *env_alignment.alignment.env);
+  const Alignment& approx = env_alignment.alignment;
+  int s1_len = alignment.seq1_max - alignment.seq1_min + 1;
+  int s2_len = alignment.seq2_max - alignment.seq2_min + 1;
+  if (alignment.seq1_min == approx.seq1_min &&
+      alignment.seq1_max == approx.seq1_max &&
+      alignment.seq2_min == approx.seq2_min &&
+      alignment.seq2_max == approx.seq2_max && s1_len > 0 && s2_len > 0 &&
+      (size_t)s1_len * s2_len <= kGlobalTracebackMaxCells) {
+    // same region, and the traceback kernel AlignGlobal uses there does not
+    // look at the score, so only the score changes
+    env_alignment.alignment.score = alignment.score;
+    env_alignment.approx = false;
+    return index;
+  }
+  SetEnvAlignment(index, alignment, AlignRegion(seq1, seq2, alignment));
+  return index;
+}
+
+size_t ProteinAligner::AlignEnvBanded(const char* seq1, const char* seq2,
+                                      int seq1_len, int seq2_len,
+                                      const AlignmentEnvironment& env,
+                                      const StartPoint& around) {
+  int found = FindEnvAlignment(env);
+  if (found >= 0) return found;
+
+  // diagonals (j - i) the alignment of around goes through
+  int i = around.alignment.seq1_min, j = around.alignment.seq2_min;
+  int diag_min = j - i, diag_max = j - i;
+  for (int c = 0; c < around.seq1_len; c++) {
+    diag_min = min(diag_min, j - i);
+    diag_max = max(diag_max, j - i);
+    if (around.seq1[c] != '_') i++;
+    if (around.seq2[c] != '_') j++;
+  }
+
+  Alignment alignment;
+  for (int margin = params_->refine_band;; margin *= 2) {
+    int lo = diag_min - margin, hi = diag_max + margin;
+    if ((lo <= -(seq1_len - 1) && hi >= seq2_len - 1) ||
+        (size_t)seq1_len * (hi - lo + 1) > kGlobalTracebackMaxCells) {
+      // the band is the whole matrix, or its trace would not fit where
+      // the linear memory AlignStrings path does
+      return AlignEnv(seq1, seq2, seq1_len, seq2_len, env);
+    }
+    int max_len = AlignBanded(seq1, seq2, seq1_len, seq2_len, env, lo, hi,
+                              alignment, buf1_, buf2_);
+    if (max_len >= 0) return AddEnvAlignment(alignment, max_len);
+  }
+}
+
+int ProteinAligner::AlignBanded(const char* seq1, const char* seq2,
+                                int seq1_len, int seq2_len,
+                                const AlignmentEnvironment& env, int lo,
+                                int hi, Alignment& result, char* o1,
+                                char* o2) {
+  // trace bits of a cell: how opt was reached, whether the row deletion
+  // (gap in seq1) and the column deletion (gap in seq2) ending there
+  // were extended rather than opened
+  enum : uint8_t {
+    kFromStart = 0,
+    kFromDiag = 1,
+    kFromRowDel = 2,
+    kFromColDel = 3,
+    kOptMask = 3,
+    kRowDelExt = 4,
+    kColDelExt = 8
+  };
+
+  lo = max(lo, -(seq1_len - 1));
+  hi = min(hi, seq2_len - 1);
+  const int width = hi - lo + 1;
+  const double gap_open = env.gap_open, gap_ext = env.gap_extend;
+
+  // cell (i, j) is at index j - i - lo of row i
+  band_rows_.resize(4 * (width + 1));
+  double* opt_prev = band_rows_.data();
+  double* opt_cur = opt_prev + width + 1;
+  double* cd_prev = opt_cur + width + 1;
+  double* cd_cur = cd_prev + width + 1;
+  band_trace_.resize((size_t)seq1_len * width);
+  // the row above the first, and one past the band on the right
+  for (int k = 0; k < width; k++) {
+    opt_prev[k] = 0;
+    cd_prev[k] = MINUSINF;
+  }
+  opt_prev[width] = opt_cur[width] = MINUSINF;
+  cd_prev[width] = cd_cur[width] = MINUSINF;
+
+  double max_score = 0;
+  int max1 = -1, max2 = -1;
+  for (int i = 0; i < seq1_len; i++) {
+    const double* score = env.matrix + seq1[i] * MATRIX_DIM;
+    uint8_t* trace = &band_trace_[(size_t)i * width];
+    // empty (k_begin == k_end) where the row's part of the band lies
+    // entirely left of seq2 or right of its end
+    int k_begin = min(width, max(0, -i - lo));
+    int k_end = max(k_begin, min(width, seq2_len - i - lo));
+    double rd = MINUSINF, opt_left = MINUSINF;
+    for (int k = k_begin; k < k_end; k++) {
+      int j = i + lo + k;
+      uint8_t t;
+      // left neighbour opens or extends the row deletion
+      double open = opt_left + gap_open;
+      rd += gap_ext;
+      t = rd >= open ? kRowDelExt : 0;
+      if (open > rd) rd = open;
+      // up neighbour is one further right in the previous row
+      double cd = cd_prev[k + 1] + gap_ext;
+      open = opt_prev[k + 1] + gap_open;
+      if (cd >= open) {
+        t |= kColDelExt;
+      } else {
+        cd = open;
+      }
+      double diag = (i > 0 && j > 0) ? opt_prev[k] : 0;
+      double opt = diag + score[(int)seq2[j]];
+      t |= diag > 0 ? kFromDiag : kFromStart;
+      if (rd > opt) {
+        opt = rd;
+        t = (t & ~kOptMask) | kFromRowDel;
+      }
+      if (cd > opt) {
+        opt = cd;
+        t = (t & ~kOptMask) | kFromColDel;
+      }
+      if (opt < 0) opt = 0;
+      if (opt > max_score) {
+        max_score = opt;
+        max1 = i;
+        max2 = j;
+      }
+      opt_cur[k] = opt;
+      cd_cur[k] = cd;
+      trace[k] = t;
+      opt_left = opt;
+    }
+    // cells of the previous row outside this row's part of the band
+    for (int k = 0; k < k_begin; k++) {
+      opt_cur[k] = 0;
+      cd_cur[k] = MINUSINF;
+    }
+    for (int k = k_end; k < width; k++) {
+      opt_cur[k] = MINUSINF;
+      cd_cur[k] = MINUSINF;
+    }
+    swap(opt_prev, opt_cur);
+    swap(cd_prev, cd_cur);
+  }
+
+  result.score = max_score;
+  result.env = &env;
+  result.seq1_max = max1;
+  result.seq2_max = max2;
+  if (max1 < 0) {
+    result.seq1_min = result.seq2_min = -1;
+    return 0;
+  }
+
+  // trace back, writing the aligned strings backwards
+  bool touched = false;
+  int i = max1, j = max2, len = 0;
+  int state = kFromDiag;
+  while (true) {
+    int k = j - i - lo;
+    if ((k == 0 && lo > -(seq1_len - 1)) || (k == width - 1 && hi < seq2_len - 1))
+      touched = true;
+    uint8_t t = band_trace_[(size_t)i * width + k];
+    if (state == kFromRowDel) {
+      o1[len] = '_';
+      o2[len++] = seq2[j];
+      if (!(t & kRowDelExt)) state = kFromDiag;
+      j--;
+      continue;
+    }
+    if (state == kFromColDel) {
+      o1[len] = seq1[i];
+      o2[len++] = '_';
+      if (!(t & kColDelExt)) state = kFromDiag;
+      i--;
+      continue;
+    }
+    // at an opt cell, follow how it was reached
+    int from = t & kOptMask;
+    if (from == kFromRowDel || from == kFromColDel) {
+      state = from;
+      continue;
+    }
+    o1[len] = seq1[i];
+    o2[len++] = seq2[j];
+    if (from == kFromStart) break;
+    i--;
+    j--;
+  }
+  if (touched) return -1;
+
+  reverse(o1, o1 + len);
+  reverse(o2, o2 + len);
+  result.seq1_min = i;
+  result.seq2_min = j;
+  return len;
+}
+
+void ProteinAligner::SetStartPoint(size_t index, StartPoint& point) {
+  const auto& env_alignment = env_alignments_[index];
+  memcpy(savebuf1_, env_alignment.seq1.data(), env_alignment.len);
+  memcpy(savebuf2_, env_alignment.seq2.data(), env_alignment.len);
   point.seq1 = savebuf1_;
   point.seq2 = savebuf2_;
+  point.seq1_len = env_alignment.len;
+  point.seq2_len = env_alignment.len;
+  point.alignment = env_alignment.alignment;
+  point.estimated_pam = env_alignment.estimated_pam;
+}
+
+void ProteinAligner::FindStartingPoint(const char* seq1, const char* seq2,
+                                       int seq1_len, int seq2_len,
+                                       StartPoint& point) {
+  if (params_->adaptive_pam_search) {
+    FindStartingPointAdaptive(seq1, seq2, seq1_len, seq2_len, point);
+    return;
+  }
 
   /*ofstream file;
   file.open(string("dump/fsp_alignment_") + to_string(filenum) +
   string(".csv")); filenum++; file << seq1_len << ", " << seq2_len << "\n";*/
 
-  for (const double& pam : pam_list_) {
-    const auto& new_env = envs_->FindNearest(pam);
+  const int num_pams = sizeof(pam_list_) / sizeof(pam_list_[0]);
+  Alignment multi_alignments[num_pams];
+  bool multi = double_kernel == DoubleKernel::AVX512F &&
+               (long)seq1_len * seq2_len <= kMultiEnvMaxCells;
+  if (multi) {
+    AlignDoubleMulti(seq1, seq2, seq1_len, seq2_len, multi_alignments);
+  }
+
+  int index[num_pams];
+  for (int p = 0; p < num_pams; p++) {
+    const auto& new_env = envs_->FindNearest(pam_list_[p]);
     // LOG(INFO) << "FSP env gap_open is " << new_env.gap_open;
-    s = AlignDouble(seq1, seq2, seq1_len, seq2_len, false, alignment, new_env);
-    // LOG(INFO) << "FSP align double score is " << alignment.score;
-
-    /*file << alignment.seq1_min << ", " << alignment.seq1_max << ", " <<
-      alignment.seq2_min
-      << ", " << alignment.seq2_max << "\n";*/
-
-    char* s1 = const_cast<char*>(seq1) + alignment.seq1_min;
-    char* s2 = const_cast<char*>(seq2) + alignment.seq2_min;
-    int s1_len = alignment.seq1_max - alignment.seq1_min + 1;  //  ?
-    int s2_len = alignment.seq2_max - alignment.seq2_min + 1;  //  ?
-    // LOG(INFO) << "FSP: s1len: " << s1_len << " s2len: " << s2_len;
-
-    int max_len = AlignStrings(new_env.matrix, s1, s1_len, s2, s2_len,
-                               alignment.score, buf1_, buf2_, 0.5e-4,
-                               new_env.gap_open, new_env.gap_extend, bt_data_);
-    envs_->EstimPam(buf1_, buf2_, max_len, estim_result);
-    // LOG(INFO) << "FSP: estim pam values: " << estim_result[0] << ", " <<
-    // estim_result[1]
-    //<< ", " << estim_result[2] << " str max len = " << max_len;
-
-    if (estim_result[0] > starting_pam) {
-      starting_pam = estim_result[0];
-      memcpy(savebuf1_, buf1_, max_len);
-      memcpy(savebuf2_, buf2_, max_len);
-      point.estimated_pam = estim_result[0];
-      point.alignment = alignment;
-      point.alignment.pam_distance = estim_result[1];
-      point.alignment.pam_variance = estim_result[2];
-      point.seq1_len = max_len;
-      point.seq2_len = max_len;
-      // point.score = alignment.score;
-      // point.env = &new_env;
-      // point.pam_dist = estim_result[1];
-      // point.pam_var = estim_result[2];
-    }
+    index[p] = multi ? AlignEnv(seq1, seq2, seq1_len, seq2_len, new_env,
+                                &multi_alignments[p])
+                     : AlignEnvApprox(seq1, seq2, seq1_len, seq2_len,
+                                      new_env);
   }
   // file.close();
+
+  auto pick = [&]() {
+    double starting_pam = -1e10;
+    int best = -1;
+    for (int p = 0; p < num_pams; p++) {
+      if (env_alignments_[index[p]].estimated_pam > starting_pam) {
+        starting_pam = env_alignments_[index[p]].estimated_pam;
+        best = p;
+      }
+    }
+    return best;
+  };
+
+  int best = pick();
+  if (best >= 0 && params_->float_start_point) {
+    // a float estimate close to the best could be the best in double
+    double best_pam = env_alignments_[index[best]].estimated_pam;
+    for (int p = 0; p < num_pams; p++) {
+      if (env_alignments_[index[p]].estimated_pam >=
+          best_pam - kFloatPamTolerance) {
+        ExactEnvAlignment(seq1, seq2, seq1_len, seq2_len, index[p]);
+      }
+    }
+    best = pick();
+  }
+  if (best >= 0) {
+    SetStartPoint(
+        ExactEnvAlignment(seq1, seq2, seq1_len, seq2_len, index[best]),
+        point);
+  }
+}
+
+void ProteinAligner::FindStartingPointAdaptive(const char* seq1,
+                                               const char* seq2, int seq1_len,
+                                               int seq2_len,
+                                               StartPoint& point) {
+  const int num_pams = sizeof(pam_list_) / sizeof(pam_list_[0]);
+  // into env_alignments_, -1 if that pam was not aligned yet
+  int index[num_pams];
+  fill(index, index + num_pams, -1);
+
+  auto align = [&](int p) {
+    if (index[p] < 0) {
+      index[p] = AlignEnv(seq1, seq2, seq1_len, seq2_len,
+                          envs_->FindNearest(pam_list_[p]));
+    }
+  };
+  auto estimated = [&](int p) {
+    return env_alignments_[index[p]].estimated_pam;
+  };
+  auto distance = [&](int p) {
+    return env_alignments_[index[p]].alignment.pam_distance;
+  };
+  // same as the exhaustive search, the lower pam wins a tie
+  auto better = [&](int p, int than) {
+    return estimated(p) > estimated(than) ||
+           (estimated(p) == estimated(than) && p < than);
+  };
+
+  // coarse: the middle of the list, then the pam EstimPam gives there
+  int best = num_pams / 2;
+  align(best);
+  int nearest = 0;
+  for (int p = 1; p < num_pams; p++) {
+    if (fabs(pam_list_[p] - distance(best)) <
+        fabs(pam_list_[nearest] - distance(best)))
+      nearest = p;
+  }
+  align(nearest);
+  if (better(nearest, best)) best = nearest;
+
+  // fine: until the best one is bracketed by aligned neighbours, trying the
+  // side its own estimate points to first
+  while (true) {
+    int toward = distance(best) > pam_list_[best] ? best + 1 : best - 1;
+    int next = -1;
+    for (int p : {toward, 2 * best - toward}) {
+      if (p >= 0 && p < num_pams && index[p] < 0) {
+        next = p;
+        break;
+      }
+    }
+    if (next < 0) break;
+    align(next);
+    if (better(next, best)) best = next;
+  }
+
+  SetStartPoint(index[best], point);
+}
+
+void ProteinAligner::AlignDoubleMulti(const char* seq1, const char* seq2,
+                                      int seq1_len, int seq2_len,
+                                      Alignment* results) {
+  const int num_pams = sizeof(pam_list_) / sizeof(pam_list_[0]);
+  if (multi_profiles_.empty()) {
+    for (int first = 0; first < num_pams; first += kMultiEnvLanes) {
+      double* matrices[kMultiEnvLanes];
+      double gap_open[kMultiEnvLanes], gap_ext[kMultiEnvLanes];
+      int n = min(kMultiEnvLanes, num_pams - first);
+      for (int k = 0; k < n; k++) {
+        const auto& env = envs_->FindNearest(pam_list_[first + k]);
+        matrices[k] = env.matrix;
+        gap_open[k] = env.gap_open;
+        gap_ext[k] = env.gap_extend;
+      }
+      multi_profiles_.push_back(createProfileDoubleMulti(
+          matrices, gap_open, gap_ext, n, kMultiEnvLanes));
+    }
+  }
+
+  double scores[kMultiEnvLanes];
+  int max1[kMultiEnvLanes], max2[kMultiEnvLanes];
+  int min1[kMultiEnvLanes], min2[kMultiEnvLanes];
+  for (size_t g = 0; g < multi_profiles_.size(); g++) {
+    align_double_local_multi_avx512(multi_profiles_[g], seq1, seq1_len, seq2,
+                                    seq2_len, scores, max1, max2, min1, min2);
+    for (int k = 0; k < kMultiEnvLanes; k++) {
+      int p = g * kMultiEnvLanes + k;
+      if (p >= num_pams) break;
+      Alignment& result = results[p];
+      result.score = scores[k];
+      result.env = &envs_->FindNearest(pam_list_[p]);
+      result.seq1_max = max1[k] - 1;
+      result.seq2_max = max2[k] - 1;
+      result.seq1_min = min1[k] - 1;
+      result.seq2_min = min2[k] - 1;
+    }
+  }
 }
 
 int CountUnderscore(const char* buf, int len) {
@@ -158,10 +660,19 @@ agd::Status ProteinAligner::AlignLocal(const char* seq1, const char* seq2,
                                        Alignment& result) {
   // find starting point
   // env find nearest point
-  agd::Status s;
   StartPoint point;
-  Alignment alignment;
-  double estim_result[3];
+  // no aligned string is longer than both sequences, one alloc for all four
+  size_t buf_len = seq1_len + seq2_len;
+  if (bufs_.size() < 4 * buf_len) {
+    bufs_.resize(4 * buf_len);
+  }
+  buf1_ = bufs_.data();
+  buf2_ = buf1_ + buf_len;
+  savebuf1_ = buf2_ + buf_len;
+  savebuf2_ = savebuf1_ + buf_len;
+  // env alignments are only reused within the same pair
+  num_env_alignments_ = 0;
+
   FindStartingPoint(seq1, seq2, seq1_len, seq2_len, point);
 
   while (true) {
@@ -172,35 +683,13 @@ agd::Status ProteinAligner::AlignLocal(const char* seq1, const char* seq2,
         &new_env)  // envs are basically static, so this is safe
       break;
 
-    s = AlignDouble(seq1, seq2, seq1_len, seq2_len, false, alignment, new_env);
-    // LOG(INFO) << "AlignLocal align double score is " << alignment.score;
-
-    char* s1 = const_cast<char*>(seq1) + alignment.seq1_min;
-    char* s2 = const_cast<char*>(seq2) + alignment.seq2_min;
-    int s1_len = alignment.seq1_max - alignment.seq1_min + 1;  //  ?
-    int s2_len = alignment.seq2_max - alignment.seq2_min + 1;  //  ?
-    // LOG(INFO) << "AlignLocal: s1len: " << s1_len << " s2len: " << s2_len;
-
-    int max_len = AlignStrings(new_env.matrix, s1, s1_len, s2, s2_len,
-                               alignment.score, buf1_, buf2_, 0.5e-4,
-                               new_env.gap_open, new_env.gap_extend, bt_data_);
-    envs_->EstimPam(buf1_, buf2_, max_len, estim_result);
-    // LOG(INFO) << "AlignLocal: estim pam values: " << estim_result[0] << ", "
-    // << estim_result[1]
-    // << ", " << estim_result[2];
-
-    point.seq1_len = max_len;
-    point.seq2_len = max_len;
-    memcpy(savebuf1_, buf1_, max_len);
-    memcpy(savebuf2_, buf2_, max_len);
-    // point.score = alignment.score;
-    // point.env = &new_env;
-    point.alignment = alignment;
-    point.estimated_pam = estim_result[0];
-    point.alignment.pam_distance = estim_result[1];
-    point.alignment.pam_variance = estim_result[2];
-    // point.pam_dist = estim_result[1];
-    // point.pam_var = estim_result[2];
+    // an env the starting point search aligned in float is redone here
+    size_t index =
+        params_->refine_band > 0
+            ? AlignEnvBanded(seq1, seq2, seq1_len, seq2_len, new_env, point)
+            : AlignEnv(seq1, seq2, seq1_len, seq2_len, new_env);
+    SetStartPoint(ExactEnvAlignment(seq1, seq2, seq1_len, seq2_len, index),
+                  point);
   }
 
   result = point.alignment;
@@ -226,14 +715,49 @@ agd::Status ProteinAligner::AlignDouble(const char* seq1, const char* seq2,
                                         bool stop_at_threshold,
                                         Alignment& result,
                                         const AlignmentEnvironment& env) {
-  ProfileDouble* profile = createProfileDoubleSSE(seq1, seq1_len, env.matrix);
-
   int max1, max2;
   auto thresh = stop_at_threshold ? env.threshold : FLT_MAX;
 
+  // the wide kernels carry the start of each path through the dp, so one
+  // pass gives both ends. their lazy F loop relies on gap_open <= gap_extend
+  if (double_kernel != DoubleKernel::SSE2 && env.gap_open <= env.gap_extend) {
+    int min1, min2;
+    double score;
+    if (env.blosum62 &&
+        AlignLocalFixed<Blosum62>(&fixed_scratch_,
+                                  double_kernel == DoubleKernel::AVX512F,
+                                  seq1, seq1_len, seq2, seq2_len, thresh,
+                                  &score, &max1, &max2, &min1, &min2)) {
+      // integer scores, same result as the double kernels below
+    } else if (double_kernel == DoubleKernel::AVX512F) {
+      double_profile_ = updateProfileDoubleAVX(double_profile_, seq1,
+                                               seq1_len, env.matrix, 8);
+      score = align_double_local_origin_avx512(
+          double_profile_, seq2, seq2_len, env.gap_open, env.gap_extend,
+          thresh, &max1, &max2, &min1, &min2);
+    } else {
+      double_profile_ = updateProfileDoubleAVX(double_profile_, seq1,
+                                               seq1_len, env.matrix, 4);
+      score = align_double_local_origin_avx2(
+          double_profile_, seq2, seq2_len, env.gap_open, env.gap_extend,
+          thresh, &max1, &max2, &min1, &min2);
+    }
+    result.score = score;
+    result.env = &env;
+    result.seq1_max = max1 - 1;
+    result.seq2_max = max2 - 1;
+    result.seq1_min = min1 - 1;
+    result.seq2_min = min2 - 1;
+    return agd::Status::OK();
+  }
+
+  // otherwise align the reversed prefixes again to find the start
+  ProfileDouble* profile = createProfileDoubleSSE(seq1, seq1_len, env.matrix);
+  reserve_bt_data(&bt_data_, seq2_len);
+
   double score =
       align_double_local(profile, seq2, seq2_len, env.gap_open, env.gap_extend,
-                         thresh, &max1, &max2, bt_data_);
+                         thresh, &max1, &max2, &bt_data_);
   max1--;
   max2--;
 
@@ -255,7 +779,7 @@ agd::Status ProteinAligner::AlignDouble(const char* seq1, const char* seq2,
 
   double score_rev = align_double_local(
       profile_rev, seq2_rev.c_str(), seq2_rev.length(), env.gap_open,
-      env.gap_extend, thresh, &max1_rev, &max2_rev, bt_data_);
+      env.gap_extend, thresh, &max1_rev, &max2_rev, &bt_data_);
   max1_rev--;
   max2_rev--;
 
@@ -283,31 +807,64 @@ agd::Status ProteinAligner::AlignDouble(const char* seq1, const char* seq2,
   return agd::Status::OK();
 }
 
-bool ProteinAligner::PassesThreshold(const char* seq1, const char* seq2,
-                                     int seq1_len, int seq2_len) {
+bool ProteinAligner::PassesThreshold(const Profile& profile, const char* seq2,
+                                     int seq2_len) {
   num_alignments_++;
-  // we use the short (int16) version for this
-  const auto& env = envs_->JustScoreEnv();
-  ProfileShort* profile =
-      swps3_createProfileShortSSE(seq1, seq1_len, env.matrix_int16);
+  int ungapped = UngappedDecision(profile, seq2, seq2_len);
+  if (ungapped != 0) {
+    return ungapped > 0;
+  }
+  // the int8 bound settles most fails, int16 only for what could pass
+  if (!PassesMinScore(profile.ScoreBound(seq2, seq2_len))) {
+    return false;
+  }
+  double value = profile.Score(seq2, seq2_len);
+  //std::cout << "ALIGNER: value is " << value << ", score is " << score;
+  return PassesMinScore(value);
+}
 
-  Options options;
-  options.gapOpen = env.gap_open_int16;
-  options.gapExt = env.gap_ext_int16;
-  options.threshold = env.threshold;
+uint64_t ProteinAligner::PassesThresholdBatch(const Profile& profile,
+                                              const char* const* targets,
+                                              const int* target_lens,
+                                              int num_targets) {
+  assert(num_targets <= kMaxBatch);
+  num_alignments_ += num_targets;
+
+  // ungapped and int8 bounds first, only targets that could pass and were
+  // not accepted ungapped go to the int16 kernel
+  const char* rerun[kMaxBatch];
+  int rerun_lens[kMaxBatch];
+  int rerun_idx[kMaxBatch];
+  int num_rerun = 0;
+  uint64_t passes = 0;
+  for (int i = 0; i < num_targets; i++) {
+    int ungapped = UngappedDecision(profile, targets[i], target_lens[i]);
+    if (ungapped > 0) {
+      passes |= uint64_t(1) << i;
+    } else if (ungapped == 0 &&
+               PassesMinScore(
+                   profile.ScoreBound(targets[i], target_lens[i]))) {
+      rerun[num_rerun] = targets[i];
+      rerun_lens[num_rerun] = target_lens[i];
+      rerun_idx[num_rerun++] = i;
+    }
+  }
 
-  // debug_profile("SHORT", profile, seq1, seq1_len, env.matrix_int16, 1);
-  // debug_alignment("SHORT", profile, seq2, seq2_len, &options);
+  if (num_rerun == 0) {
+    return passes;
+  }
+  double values[kMaxBatch];
+  profile.ScoreBatch(rerun, rerun_lens, num_rerun, values);
 
-  double score = swps3_alignmentShortSSE(profile, seq2, seq2_len, &options);
-  double value;
-  if (score >= FLT_MAX)
-    value = SHRT_MAX;
-  else
-    value = score / (65535.0f / options.threshold);
+  for (int i = 0; i < num_rerun; i++) {
+    if (PassesMinScore(values[i])) {
+      passes |= uint64_t(1) << rerun_idx[i];
+    }
+  }
+  return passes;
+}
 
-  swps3_freeProfileShortSSE(profile);
-  //std::cout << "ALIGNER: value is " << value << ", score is " << score;
+bool ProteinAligner::PassesMinScore(double value) const {
   if (params_->use_blosum) {
     return value >= params_->min_score;
   } else {
@@ -315,40 +872,215 @@ bool ProteinAligner::PassesThreshold(const char* seq1, const char* seq2,
   }
 }
 
+int ProteinAligner::UngappedDecision(const Profile& profile, const char* seq2,
+                                     int seq2_len) {
+  if (params_->ungapped_xdrop <= 0) {
+    return 0;
+  }
+  double min_score = params_->use_blosum ? params_->min_score
+                                         : 0.75f * params_->min_score;
+  double value = profile.UngappedScore(seq2, seq2_len,
+                                       params_->ungapped_xdrop, min_score);
+  // a gapped alignment scores at least as much as an ungapped one
+  if (PassesMinScore(value)) {
+    num_ungapped_accepted_++;
+    return 1;
+  }
+  if (value < params_->ungapped_reject_fraction * min_score) {
+    num_ungapped_rejected_++;
+    return -1;
+  }
+  return 0;
+}
+
+bool ProteinAligner::PassesThreshold(const char* seq1, const char* seq2,
+                                     int seq1_len, int seq2_len) {
+  // we use the short (int16) version for this
+  Profile profile(seq1, seq1_len, envs_->JustScoreEnv());
+  return PassesThreshold(profile, seq2, seq2_len);
+}
+
 bool ProteinAligner::LogPamPassesThreshold(const char* seq1, const char* seq2,
                                      int seq1_len, int seq2_len) {
   num_alignments_++;
   // we use the short (int16) version for this
-  const auto& env = envs_->LogPamJustScoreEnv();
-  ProfileShort* profile =
-      swps3_createProfileShortSSE(seq1, seq1_len, env.matrix_int16);
-
-  Options options;
-  options.gapOpen = env.gap_open_int16;
-  options.gapExt = env.gap_ext_int16;
-  options.threshold = env.threshold;
-
-  // debug_profile("SHORT", profile, seq1, seq1_len, env.matrix_int16, 1);
-  // debug_alignment("SHORT", profile, seq2, seq2_len, &options);
-
-  double score = swps3_alignmentShortSSE(profile, seq2, seq2_len, &options);
-  double value;
-  if (score >= FLT_MAX)
-    value = SHRT_MAX;
-  else
-    value = score / (65535.0f / options.threshold);
-
-  swps3_freeProfileShortSSE(profile);
+  Profile profile(seq1, seq1_len, envs_->LogPamJustScoreEnv());
+  if (profile.ScoreBound(seq2, seq2_len) < 0.75f * params_->min_score) {
+    return false;
+  }
+  double value = profile.Score(seq2, seq2_len);
   //std::cout << "ALIGNER: value is " << value << ", score is " << score;
   return value >= 0.75f * params_->min_score;
 }
 
+bool ProteinAligner::PassesThreshold(const Profile& profile,
+                                     const Sequence& seq1,
+                                     const Sequence& seq2) {
+  bool passes;
+  if (pair_cache_ && pair_cache_->FindThreshold(ThresholdKind(*params_),
+                                                seq1.ID(), seq2.ID(),
+                                                &passes)) {
+    return passes;
+  }
+  passes = PassesThreshold(profile, seq2.Seq().data(), seq2.Seq().size());
+  if (pair_cache_) {
+    pair_cache_->InsertThreshold(ThresholdKind(*params_), seq1.ID(),
+                                 seq2.ID(), passes);
+  }
+  return passes;
+}
+
+uint64_t ProteinAligner::PassesThresholdBatch(const Profile& profile,
+                                              const Sequence& seq1,
+                                              const Sequence* const* targets,
+                                              int num_targets) {
+  assert(num_targets <= kMaxBatch);
+  auto kind = ThresholdKind(*params_);
+  // only the targets not in the cache are aligned
+  const char* seqs[kMaxBatch];
+  int lens[kMaxBatch];
+  int idx[kMaxBatch];
+  int num_aligned = 0;
+  uint64_t passes = 0;
+  for (int i = 0; i < num_targets; i++) {
+    bool cached;
+    if (pair_cache_ &&
+        pair_cache_->FindThreshold(kind, seq1.ID(), targets[i]->ID(),
+                                   &cached)) {
+      passes |= uint64_t(cached) << i;
+    } else {
+      seqs[num_aligned] = targets[i]->Seq().data();
+      lens[num_aligned] = targets[i]->Seq().size();
+      idx[num_aligned++] = i;
+    }
+  }
+  if (num_aligned == 0) {
+    return passes;
+  }
+
+  uint64_t aligned = PassesThresholdBatch(profile, seqs, lens, num_aligned);
+  for (int i = 0; i < num_aligned; i++) {
+    bool pass = aligned & (uint64_t(1) << i);
+    passes |= uint64_t(pass) << idx[i];
+    if (pair_cache_) {
+      pair_cache_->InsertThreshold(kind, seq1.ID(), targets[idx[i]]->ID(),
+                                   pass);
+    }
+  }
+  return passes;
+}
+
+bool ProteinAligner::LogPamPassesThreshold(const Sequence& seq1,
+                                           const Sequence& seq2) {
+  auto kind = PairCache::Kind::kLogPamThreshold;
+  bool passes;
+  if (pair_cache_ &&
+      pair_cache_->FindThreshold(kind, seq1.ID(), seq2.ID(), &passes)) {
+    return passes;
+  }
+  passes = LogPamPassesThreshold(seq1.Seq().data(), seq2.Seq().data(),
+                                 seq1.Seq().size(), seq2.Seq().size());
+  if (pair_cache_) {
+    pair_cache_->InsertThreshold(kind, seq1.ID(), seq2.ID(), passes);
+  }
+  return passes;
+}
+
+agd::Status ProteinAligner::AlignSingle(const Sequence& seq1,
+                                        const Sequence& seq2,
+                                        Alignment& result) {
+  auto kind = PairCache::Kind::kAlignSingle;
+  if (pair_cache_ &&
+      pair_cache_->FindAlignment(kind, seq1.ID(), seq2.ID(), &result)) {
+    return agd::Status::OK();
+  }
+  agd::Status s = AlignSingle(seq1.Seq().data(), seq2.Seq().data(),
+                              seq1.Seq().size(), seq2.Seq().size(), result);
+  if (s.ok() && pair_cache_) {
+    pair_cache_->InsertAlignment(kind, seq1.ID(), seq2.ID(), result);
+  }
+  return s;
+}
+
+agd::Status ProteinAligner::AlignLocal(const Sequence& seq1,
+                                       const Sequence& seq2,
+                                       Alignment& result) {
+  auto kind = PairCache::Kind::kAlignLocal;
+  if (pair_cache_ &&
+      pair_cache_->FindAlignment(kind, seq1.ID(), seq2.ID(), &result)) {
+    return agd::Status::OK();
+  }
+  agd::Status s = AlignLocal(seq1.Seq().data(), seq2.Seq().data(),
+                             seq1.Seq().size(), seq2.Seq().size(), result);
+  if (s.ok() && pair_cache_) {
+    pair_cache_->InsertAlignment(kind, seq1.ID(), seq2.ID(), result);
+  }
+  return s;
+}
+
+double ProteinAligner::ScoreBound(const AlignmentEnvironment& env,
+                                  const char* seq, int seq_len) {
+  int row_max[MATRIX_DIM];
+  for (int i = 0; i < MATRIX_DIM; i++) {
+    row_max[i] = 0;
+    for (int j = 0; j < MATRIX_DIM; j++) {
+      row_max[i] = max(row_max[i], int(env.matrix_int16[i * MATRIX_DIM + j]));
+    }
+  }
+  int64_t bound = 0;
+  for (int i = 0; i < seq_len; i++) {
+    bound += row_max[int(seq[i])];
+  }
+  // the int16 kernel saturates at the threshold, Profile::Score then
+  // returns SHRT_MAX
+  if (bound >= 65535) {
+    return SHRT_MAX;
+  }
+  return bound / (65535.0f / env.threshold);
+}
+
+void ProteinAligner::SetScoreBounds(const AlignmentEnvironments& envs,
+                                    Sequence* seq) {
+  seq->SetScoreBounds(
+      ScoreBound(envs.JustScoreEnv(), seq->Seq().data(), seq->Seq().size()),
+      ScoreBound(envs.LogPamJustScoreEnv(), seq->Seq().data(),
+                 seq->Seq().size()));
+}
+
+bool ProteinAligner::MayPassThreshold(const Sequence& seq1,
+                                      const Sequence& seq2) {
+  if (params_->max_composition_distance > 0 &&
+      CompositionDistance(seq1, seq2) > params_->max_composition_distance) {
+    num_composition_skipped_++;
+    return false;
+  }
+  if (!PassesMinScore(min(seq1.ScoreBound(), seq2.ScoreBound()))) {
+    num_bound_skipped_++;
+    return false;
+  }
+  if (params_->kmer_size > 0 &&
+      !kmer_filter_.SharesDiagonal(seq1, seq2, params_->kmer_min_hits)) {
+    num_kmer_skipped_++;
+    return false;
+  }
+  return true;
+}
+
+bool ProteinAligner::MayPassLogPamThreshold(const Sequence& seq1,
+                                            const Sequence& seq2) {
+  if (min(seq1.LogPamScoreBound(), seq2.LogPamScoreBound()) >=
+      0.75f * params_->min_score) {
+    return true;
+  }
+  num_bound_skipped_++;
+  return false;
+}
+
 double ProteinAligner::c_align_double_global(double* matrix, const char* s1,
                                              int ls1, const char* s2, int ls2,
                                              double gap_open, double gap_ext,
                                              BTData* data) {
   int i, j, k;
-  int *AToInts2 = NULL;
 
   // double coldel[MAXSEQLEN+1], S[MAXSEQLEN+1];
   // int DelFrom[MAXSEQLEN+1];
@@ -363,14 +1095,13 @@ double ProteinAligner::c_align_double_global(double* matrix, const char* s1,
 
   DelFixed = gap_open;
   DelIncr = gap_ext;
+  reserve_bt_data(data, ls2);
 
   /*MaxScore = MINUSINF;*/
-  AToInts2 = (int*) malloc((ls2 + 1) * sizeof(int));
   data->S[0] = data->coldel[0] = 0;
   for (j = 1; j <= ls2; j++) {
     /*if (s2[j - 1] == '_')
      *     userror("underscores cannot be used in sequence alignment");*/
-    AToInts2[j] = /*MapSymbol(s2[j - 1], DM)*/ s2[j - 1];
     data->coldel[j] = MINUSINF;
     data->S[j] = /*(mode == CFE || mode == Local) ? 0 : */ data->S[j - 1] +
                  (j == 1 ? DelFixed : DelIncr);
@@ -416,7 +1147,7 @@ double ProteinAligner::c_align_double_global(double* matrix, const char* s1,
       /* TODO: check that det vs prob can never be a Self */
       t = NoSelf /*&& ProbSeqCnt == 0*/ && s1 + i == s2 + j
               ? MINUSINF
-              : Sj1 + Score_s1[AToInts2[j]];
+              : Sj1 + Score_s1[(int)s2[j - 1]];
       if (t < rowdel) t = rowdel;
       if (t < data->coldel[j]) t = data->coldel[j];
 
@@ -464,11 +1195,36 @@ double ProteinAligner::c_align_double_global(double* matrix, const char* s1,
    *               if (mode == Global) {
    *                 *Max1 = ls1;
    *                   *Max2 = ls2;*/
-  free(AToInts2);
   return (data->S[ls2]);
   /*}
    *   return (MaxScore);*/
 }
+int ProteinAligner::AlignGlobal(const AlignmentEnvironment& env, char* s1,
+                                int len1, char* s2, int len2, double escore,
+                                char* o1, char* o2) {
+  if (len1 <= 0 || len2 <= 0 ||
+      (size_t)len1 * len2 > kGlobalTracebackMaxCells) {
+    return AlignStrings(env.matrix, s1, len1, s2, len2, escore, o1, o2, 0.5e-4,
+                        env.gap_open, env.gap_extend, &bt_data_);
+  }
+
+  double score;
+  switch (double_kernel) {
+    case DoubleKernel::AVX512F:
+      return align_double_global_avx512(&global_arena_, env.matrix, s1, len1,
+                                        s2, len2, env.gap_open,
+                                        env.gap_extend, o1, o2, &score);
+    case DoubleKernel::AVX2:
+      return align_double_global_avx2(&global_arena_, env.matrix, s1, len1,
+                                      s2, len2, env.gap_open, env.gap_extend,
+                                      o1, o2, &score);
+    default:
+      return align_double_global_sse2(&global_arena_, env.matrix, s1, len1,
+                                      s2, len2, env.gap_open, env.gap_extend,
+                                      o1, o2, &score);
+  }
+}
+
 // copied directly from pyopa python extension
 int ProteinAligner::AlignStrings(double* matrix, char* s1, int len1, char* s2,
                                  int len2, double escore, char* o1, char* o2,
@@ -479,6 +1235,8 @@ int ProteinAligner::AlignStrings(double* matrix, char* s1, int len1, char* s2,
   double *S1 = NULL, *coldel1 = NULL;
   double Slen2i, maxs, t;
   char *tprs1 = NULL, *tprs2 = NULL, *prs1, *prs2;
+  // the scratch is shared with the recursive calls below, everything in it
+  // is read before they run
   double tot;
 
 
@@ -553,19 +1311,22 @@ int ProteinAligner::AlignStrings(double* matrix, char* s1, int len1, char* s2,
   /* reverse strings */
   if (s1 - s2 >= 0 && s2 + len2 - s1 > 0) {
     j = MMAX(s1 - s2 + len1, len2);
-    tprs1 = (char*) malloc(j * sizeof(char));
+    strings_rev_.resize(j);
+    tprs1 = strings_rev_.data();
     for (i = 0; i < j; i++) tprs1[j - 1 - i] = s2[i];
     prs1 = tprs1 + (j + s2 - s1 - len1);
     prs2 = tprs1 + (j - len2);
   } else if (s2 - s1 >= 0 && s1 + len1 - s2 > 0) {
     j = MMAX(s2 - s1 + len2, len1);
-    tprs1 = (char*) malloc(j * sizeof(char));
+    strings_rev_.resize(j);
+    tprs1 = strings_rev_.data();
     for (i = 0; i < j; i++) tprs1[j - 1 - i] = s1[i];
     prs2 = tprs1 + (j + s1 - s2 - len2);
     prs1 = tprs1 + (j - len1);
   } else {
-    tprs1 = (char*) malloc(len1 * sizeof(char));
-    tprs2 = (char*) malloc(len2 * sizeof(char));
+    strings_rev_.resize(len1 + len2);
+    tprs1 = strings_rev_.data();
+    tprs2 = tprs1 + len1;
     for (i = 0; i < len2; i++) tprs2[len2 - 1 - i] = s2[i];
     for (i = 0; i < len1; i++) tprs1[len1 - 1 - i] = s1[i];
     prs1 = tprs1;
@@ -577,9 +1338,11 @@ int ProteinAligner::AlignStrings(double* matrix, char* s1, int len1, char* s2,
   /*seq1.ds = s1;
    *   seq2.ds = s2;*/
   c_align_double_global(matrix, s1, i1, s2, len2, gap_open, gap_ext, data);
-  S1 = (double*) malloc((len2 + 1) * sizeof(double));
-  coldel1 = (double*) malloc((len2 + 1) * sizeof(double));
-  DelFrom1 = (int*) malloc((len2 + 1) * sizeof(int));
+  strings_scores_.resize(2 * (len2 + 1));
+  strings_del_from_.resize(len2 + 1);
+  S1 = strings_scores_.data();
+  coldel1 = S1 + len2 + 1;
+  DelFrom1 = strings_del_from_.data();
   for (i = 0; i <= len2; i++) {
     S1[i] = data->S[i];
     coldel1[i] = data->coldel[i];
@@ -609,7 +1372,6 @@ int ProteinAligner::AlignStrings(double* matrix, char* s1, int len1, char* s2,
                      gap_ext, data);
     j += AlignStrings(matrix, s1 + i1, len1 - i1, s2 + i, len2 - i, Slen2i,
                       o1 + j, o2 + j, 0.0, gap_open, gap_ext, data);
-    free(tprs1); free(tprs2); free(S1); free(DelFrom1); free(coldel1);
     return (j);
   }
 
@@ -629,7 +1391,6 @@ int ProteinAligner::AlignStrings(double* matrix, char* s1, int len1, char* s2,
     len += AlignStrings(matrix, s1 + i4 - 1, len1 - i4 + 1, s2 + i, len2 - i,
                         Slen2i - gap_open - gap_ext * (i4 - i1 - 2), o1 + len,
                         o2 + len, 0.0, gap_open, gap_ext, data);
-    free(tprs1); free(tprs2); free(S1); free(DelFrom1); free(coldel1);
     return (len);
   }
   return 0;
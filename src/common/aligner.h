@@ -1,8 +1,21 @@
 #pragma once
 
+#include <vector>
 #include "alignment_environment.h"
+#include "fixed_kernels.h"
+#include "float_kernels.h"
+#include "kmer_filter.h"
 #include "params.h"
+#include "profile_cache.h"
+#include "sequence.h"
+extern "C" {
+#include "swps3/DynProgr_avx_double.h"
+#include "swps3/DynProgr_global_double.h"
+#include "swps3/DynProgr_multi_double.h"
 #include "swps3/extras.h"
+}
+
+class PairCache;
 
 // copied aligner class from Persona, so we are using AGD Status here
 // quite a bit
@@ -30,16 +43,24 @@ class ProteinAligner {
     }
   };
 
-  ProteinAligner(const AlignmentEnvironments* envs, const Parameters* params)
-      : envs_(envs), params_(params) {
-    bt_data_ = new BTData();
-  }
+  // pair_cache is shared by the aligners of a run, see PairResults()
+  ProteinAligner(const AlignmentEnvironments* envs, const Parameters* params,
+                 PairCache* pair_cache = nullptr)
+      : envs_(envs),
+        params_(params),
+        pair_cache_(pair_cache),
+        profiles_(envs->JustScoreEnv()) {}
 
   ~ProteinAligner() {
-    if (buf1_) {
-      delete[] buf1_;
+    free_bt_data(&bt_data_);
+    if (double_profile_) {
+      free_profile_double_avx(double_profile_);
     }
-    delete bt_data_;
+    for (auto* p : multi_profiles_) {
+      free_profile_double_multi(p);
+    }
+    free_global_double_arena(&global_arena_);
+    freePamScratch(&pam_scratch_);
   }
 
   agd::Status AlignLocal(const char* seq1, const char* seq2, int seq1_len,
@@ -48,9 +69,42 @@ class ProteinAligner {
   bool PassesThreshold(const char* seq1, const char* seq2, int seq1_len,
                        int seq2_len);
 
+  // same as above, with a prebuilt just score env profile of seq1
+  // (see Profiles()), avoids rebuilding it for every target
+  bool PassesThreshold(const Profile& profile, const char* seq2, int seq2_len);
+
+  // PassesThreshold() of one profile against num_targets <= kMaxBatch
+  // targets, scored several per SIMD vector with one target in each lane.
+  // Bit i of the result is set if targets[i] passes.
+  static const int kMaxBatch = 64;
+  uint64_t PassesThresholdBatch(const Profile& profile,
+                                const char* const* targets,
+                                const int* target_lens, int num_targets);
+
   bool LogPamPassesThreshold(const char* seq1, const char* seq2, int seq1_len,
                        int seq2_len);
 
+  // upper bound of the threshold score (Profile::Score) of seq against
+  // any other sequence under env: each residue aligned to its best
+  // partner in the int16 matrix, which for the usual matrices is seq's
+  // self-score, and no gaps. SHRT_MAX where the kernel could return that
+  static double ScoreBound(const AlignmentEnvironment& env, const char* seq,
+                           int seq_len);
+
+  // ScoreBound() of seq under the just score and logpam just score envs,
+  // stored in seq
+  static void SetScoreBounds(const AlignmentEnvironments& envs,
+                             Sequence* seq);
+
+  // false if the score bounds of seq1 and seq2 show they can't pass
+  // PassesThreshold() / LogPamPassesThreshold(). those pairs are counted
+  // in NumBoundSkipped() instead of NumAlignments(). MayPassThreshold()
+  // also rejects pairs by amino acid composition and the KmerFilter if
+  // Parameters::max_composition_distance / kmer_size are set, counting
+  // those in NumCompositionSkipped() / NumKmerSkipped()
+  bool MayPassThreshold(const Sequence& seq1, const Sequence& seq2);
+  bool MayPassLogPamThreshold(const Sequence& seq1, const Sequence& seq2);
+
   // with full range calc
   agd::Status AlignDouble(const char* seq1, const char* seq2, int seq1_len,
                           int seq2_len, bool stop_at_threshold,
@@ -61,15 +115,59 @@ class ProteinAligner {
   agd::Status AlignSingle(const char* seq1, const char* seq2, int seq1_len,
                           int seq2_len, Alignment& result);
 
+  // the threshold checks and alignments above for sequences of the run,
+  // answered from PairResults() if it has the pair and stored there if
+  // not. profile is the just score env profile of seq1
+  bool PassesThreshold(const Profile& profile, const Sequence& seq1,
+                       const Sequence& seq2);
+  uint64_t PassesThresholdBatch(const Profile& profile, const Sequence& seq1,
+                                const Sequence* const* targets,
+                                int num_targets);
+  bool LogPamPassesThreshold(const Sequence& seq1, const Sequence& seq2);
+  agd::Status AlignSingle(const Sequence& seq1, const Sequence& seq2,
+                          Alignment& result);
+  agd::Status AlignLocal(const Sequence& seq1, const Sequence& seq2,
+                         Alignment& result);
+
+  // name of the widest int16 threshold kernel this CPU has
+  static const char* ShortKernelName();
+  // picks the int16 threshold kernel per query and target length class,
+  // see Profile::TuneKernels. call once before aligning
+  static agd::Status TuneShortKernels(const AlignmentEnvironments& envs,
+                                      const std::string& tuning_file);
+  // the kernel picked per length class, for printing
+  static std::string ShortKernelTable();
+  // name of the double local alignment kernel selected for this CPU
+  static const char* DoubleKernelName();
+
   const Parameters* Params() { return params_; }
   const AlignmentEnvironments* Envs() { return envs_; }
+  // results shared between the aligners of a run, nullptr if
+  // Parameters::pair_cache_mb is 0
+  PairCache* PairResults() { return pair_cache_; }
 
   size_t NumAlignments() { return num_alignments_; }
+  size_t NumBoundSkipped() { return num_bound_skipped_; }
+  size_t NumKmerSkipped() { return num_kmer_skipped_; }
+  size_t NumCompositionSkipped() { return num_composition_skipped_; }
+  // threshold alignments settled by the ungapped stage, see
+  // Parameters::ungapped_xdrop
+  size_t NumUngappedAccepted() { return num_ungapped_accepted_; }
+  size_t NumUngappedRejected() { return num_ungapped_rejected_; }
+
+  // just score env profiles of reps, cleared at the end of each merge
+  ProfileCache& Profiles() { return profiles_; }
 
  private:
   const AlignmentEnvironments* envs_;
   const Parameters* params_;
+  PairCache* pair_cache_;
   size_t num_alignments_ = 0;
+  size_t num_bound_skipped_ = 0;
+  size_t num_kmer_skipped_ = 0;
+  size_t num_composition_skipped_ = 0;
+  size_t num_ungapped_accepted_ = 0;
+  size_t num_ungapped_rejected_ = 0;
 
   struct StartPoint {
     Alignment alignment;
@@ -80,9 +178,87 @@ class ProteinAligner {
     int seq2_len;
   };
 
+  bool PassesMinScore(double value) const;
+
+  // ungapped seed-and-extend stage of the threshold alignments. 1 if the
+  // pair passes on its ungapped score, -1 if that is low enough to reject
+  // it, 0 if the gapped kernels have to decide
+  int UngappedDecision(const Profile& profile, const char* seq2,
+                       int seq2_len);
+
   void FindStartingPoint(const char* seq1, const char* seq2, int seq1_len,
                          int seq2_len, StartPoint& point);
 
+  // same, aligning only the 3-5 envs around where EstimPam points instead
+  // of all of pam_list_ (Parameters::adaptive_pam_search). approximate, it
+  // misses a better env that is not next to a bracketing one
+  void FindStartingPointAdaptive(const char* seq1, const char* seq2,
+                                 int seq1_len, int seq2_len,
+                                 StartPoint& point);
+
+  // AlignDouble, AlignStrings and EstimPam of the current pair under one
+  // env, kept until the next AlignLocal so no env is aligned twice
+  struct EnvAlignment {
+    Alignment alignment;  // with the EstimPam distance and variance
+    double estimated_pam;
+    int len;  // of the aligned strings
+    std::vector<char> seq1;
+    std::vector<char> seq2;
+    // local part by the float kernel, see AlignEnvApprox
+    bool approx;
+  };
+
+  // index in env_alignments_ of the alignment of the pair under env,
+  // aligning it if needed. local is its AlignDouble result, if known
+  size_t AlignEnv(const char* seq1, const char* seq2, int seq1_len,
+                  int seq2_len, const AlignmentEnvironment& env,
+                  const Alignment* local = nullptr);
+
+  // AlignEnv with the local alignment from the float kernel where it
+  // applies (Parameters::float_start_point), the result is marked approx
+  size_t AlignEnvApprox(const char* seq1, const char* seq2, int seq1_len,
+                        int seq2_len, const AlignmentEnvironment& env);
+
+  // redoes the alignment at index in double if it is approx, in place
+  size_t ExactEnvAlignment(const char* seq1, const char* seq2, int seq1_len,
+                           int seq2_len, size_t index);
+
+  // same as AlignEnv, but only aligns within refine_band diagonals of the
+  // alignment of around, widening the band while the best path touches it
+  size_t AlignEnvBanded(const char* seq1, const char* seq2, int seq1_len,
+                        int seq2_len, const AlignmentEnvironment& env,
+                        const StartPoint& around);
+
+  // index in env_alignments_ of env, -1 if not aligned yet
+  int FindEnvAlignment(const AlignmentEnvironment& env);
+  // stores alignment and its aligned strings in buf1_, buf2_ with the
+  // EstimPam results
+  size_t AddEnvAlignment(const Alignment& alignment, int max_len);
+  void SetEnvAlignment(size_t index, const Alignment& alignment, int max_len);
+  // global alignment of the region of the local one into buf1_, buf2_
+  int AlignRegion(const char* seq1, const char* seq2,
+                  const Alignment& alignment);
+
+  void SetStartPoint(size_t index, StartPoint& point);
+
+  // local alignment restricted to the diagonals lo <= j - i <= hi, with
+  // the aligned strings in o1, o2 like AlignStrings. returns their length,
+  // or -1 if the best path touches an edge of the band inside the matrix,
+  // a wider band might score higher then
+  int AlignBanded(const char* seq1, const char* seq2, int seq1_len,
+                  int seq2_len, const AlignmentEnvironment& env, int lo,
+                  int hi, Alignment& result, char* o1, char* o2);
+
+  // AlignDouble() under the envs of all of pam_list_ in one sweep, one env
+  // per lane. results are in pam_list_ order. AVX-512F only
+  void AlignDoubleMulti(const char* seq1, const char* seq2, int seq1_len,
+                        int seq2_len, Alignment* results);
+
+  // global alignment of s1 and s2 under env with the aligned strings in
+  // o1, o2, by the SIMD traceback kernel when it fits, else AlignStrings
+  int AlignGlobal(const AlignmentEnvironment& env, char* s1, int len1,
+                  char* s2, int len2, double escore, char* o1, char* o2);
+
   int AlignStrings(double* matrix, char* s1, int len1, char* s2, int len2,
                    double escore, char* o1, char* o2, double maxerr,
                    double gap_open, double gap_ext, BTData* data);
@@ -91,11 +267,42 @@ class ProteinAligner {
                                const char* s2, int ls2, double gap_open,
                                double gap_ext, BTData* data);
 
-  // these are for reuse over align double/local methods
-  char* buf1_ = nullptr;      // MAXSEQLEN
-  char* buf2_ = nullptr;      // MAXSEQLEN
-  char* savebuf1_ = nullptr;  // MAXSEQLEN
-  char* savebuf2_ = nullptr;  // MAXSEQLEN
+  // these are for reuse over align double/local methods, each
+  // seq1_len + seq2_len of the current AlignLocal pair, in bufs_
+  std::vector<char> bufs_;
+  char* buf1_ = nullptr;
+  char* buf2_ = nullptr;
+  char* savebuf1_ = nullptr;
+  char* savebuf2_ = nullptr;
+
+  // dp rows of align_double_local and c_align_double_global, grown to the
+  // longest sequence aligned
+  BTData bt_data_ = {nullptr, nullptr, nullptr, 0};
+  // AlignDouble profile, grown as needed
+  ProfileDoubleAVX* double_profile_ = nullptr;
+  // AlignDouble scratch for the BLOSUM62 kernels
+  FixedKernelScratch fixed_scratch_;
+  // AlignEnvApprox scratch
+  FloatKernelScratch float_scratch_;
+  std::vector<EnvAlignment> env_alignments_;
+  size_t num_env_alignments_ = 0;
+
+  // AlignBanded scratch
+  std::vector<double> band_rows_;
+  std::vector<uint8_t> band_trace_;
+
+  // AlignGlobal traceback kernel scratch, and the AlignStrings one
+  GlobalDoubleArena global_arena_ = {nullptr, 0};
+  std::vector<double> strings_scores_;
+  std::vector<int> strings_del_from_;
+  std::vector<char> strings_rev_;
+  // EstimPam scratch
+  PamScratch pam_scratch_ = {nullptr, 0};
+
+  // pam_list_ envs, 8 per profile, built on first use
+  std::vector<ProfileDoubleMulti*> multi_profiles_;
+
+  ProfileCache profiles_;
 
-  BTData* bt_data_;
+  KmerFilter kmer_filter_;
 };
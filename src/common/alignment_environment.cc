@@ -1,7 +1,9 @@
 
 #include "alignment_environment.h"
+#include <algorithm>
 #include <iostream>
 #include <string>
+#include "fixed_kernels.h"
 
 extern "C" {
 #include "swps3/DynProgr_scalar.h"
@@ -11,9 +13,10 @@ extern "C" {
 
 // len is seq1 len
 void AlignmentEnvironments::EstimPam(char* seq1, char* seq2, int len,
-                                     double result[3]) const {
-  EstimatePam(seq1, seq2, len, day_matrices_, (int)envs_.size(),
-              logpam_env_.matrix, result);
+                                     double result[3],
+                                     PamScratch* scratch) const {
+  EstimatePam(seq1, seq2, len, day_matrices_, day_table_, (int)envs_.size(),
+              logpam_env_.matrix, scratch, result);
 }
 
 using namespace std;
@@ -61,12 +64,48 @@ int16_t* CreateScaled(double* matrix, double threshold, double gap,
   return ret;
 }
 
+// compares the int8 and int16 tables entry by entry. the int8 kernel must
+// use the same gap model (affine or linear) as the int16 one, and the
+// biased byte profile and gaps must fit in a byte
+void SetInt8Bound(AlignmentEnvironment* env) {
+  int bias = 0, max_score = 0;
+  for (size_t i = 0; i < MDIM; i++) {
+    bias = max(bias, -int(env->matrix_int8[i]));
+    max_score = max(max_score, int(env->matrix_int8[i]));
+  }
+  bool linear_int8 = env->gap_ext_int8 <= env->gap_open_int8;
+  bool linear_int16 = env->gap_ext_int16 <= env->gap_open_int16;
+  env->int8_bound = linear_int8 == linear_int16 && max_score + bias <= 255 &&
+                    env->gap_open_int8 <= 0 && env->gap_open_int8 > -128 &&
+                    env->gap_ext_int8 <= 0 && env->gap_ext_int8 > -128;
+  if (!env->int8_bound) return;
+
+  // any positive ratio gives a valid bound, the scale factors a tight one
+  double ratio =
+      ShortFactor(env->threshold) / ByteFactor(env->matrix, env->threshold);
+  env->int8_ratio = ratio;
+  env->int8_match_err = 0;
+  for (size_t i = 0; i < MDIM; i++) {
+    env->int8_match_err =
+        max(env->int8_match_err,
+            env->matrix_int16[i] - ratio * env->matrix_int8[i]);
+  }
+  env->int8_gap_err =
+      max(0.0, env->gap_open_int16 - ratio * env->gap_open_int8);
+  if (!linear_int16) {
+    env->int8_gap_err = max(env->int8_gap_err,
+                            env->gap_ext_int16 - ratio * env->gap_ext_int8);
+  }
+}
+
 const AlignmentEnvironment& AlignmentEnvironments::FindNearest(
     double pam) const {
   size_t i = 0;
-  while (pam - envs_[i].pam_distance > 0.0f && i < envs_.size()) i++;
+  while (i < envs_.size() && pam - envs_[i].pam_distance > 0.0f) i++;
   if (i == envs_.size())
     return envs_[i - 1];
+  else if (i == 0)
+    return envs_[0];
   else {
     if (fabs(envs_[i].pam_distance - pam) <
         fabs(envs_[i - 1].pam_distance - pam))
@@ -95,6 +134,7 @@ void AlignmentEnvironments::CreateDayMatrices(vector<double>& gap_open,
   day_matrices_ =
       createDayMatrices(&gap_open[0], &gap_ext[0], &pam_dist[0],
                         (long long*)&matrices[0], (int)gap_open.size() - 1);
+  day_table_ = createDayMatrixTable(day_matrices_, (int)gap_open.size() - 1);
 }
 
 void ReadJsonEnv(const json& json_env, AlignmentEnvironment* env) {
@@ -130,6 +170,7 @@ void ReadJsonEnv(const json& json_env, AlignmentEnvironment* env) {
   env->matrix_int8 =
       CreateScaled(env->matrix, env->threshold, env->gap_open, env->gap_extend,
                    env->gap_open_int8, env->gap_ext_int8);
+  SetInt8Bound(env);
 }
 
 void AlignmentEnvironments::InitFromJSON(const json& logpam_json,
@@ -176,6 +217,8 @@ void AlignmentEnvironments::InitFromJSON(const json& logpam_json,
       logpam_just_score_.matrix, logpam_just_score_.threshold,
       logpam_just_score_.gap_open, logpam_just_score_.gap_extend,
       logpam_just_score_.gap_open_int16, logpam_just_score_.gap_ext_int16);
+  SetInt8Bound(&just_score_env_);
+  SetInt8Bound(&logpam_just_score_);
 
   /*cout << "just score int 16\n";
   for (size_t i = 0; i < DIMSIZE; i++) {
@@ -242,4 +285,8 @@ void AlignmentEnvironments::UseBlosum(const json& blosum_json,
       CreateScaled(just_score_env_.matrix, just_score_env_.threshold,
                    just_score_env_.gap_open, just_score_env_.gap_extend,
                    just_score_env_.gap_open_int8, just_score_env_.gap_ext_int8);
+  SetInt8Bound(&just_score_env_);
+  just_score_env_.blosum62 =
+      Blosum62::Matches(just_score_env_.matrix, just_score_env_.gap_open,
+                        just_score_env_.gap_extend);
 }
\ No newline at end of file
@@ -26,6 +26,17 @@ struct AlignmentEnvironment {
   int16_t gap_open_int16;
   int16_t gap_ext_int16;
   int16_t* matrix_int16 = nullptr;
+  // the int16 score of an alignment is at most int8_ratio times its int8
+  // score, plus int8_match_err per aligned pair and int8_gap_err per gap
+  // position. lets the int8 kernel settle threshold fails, see
+  // SetInt8Bound(). false if the int8 tables can't be used that way
+  bool int8_bound = false;
+  double int8_ratio = 0;
+  double int8_match_err = 0;
+  double int8_gap_err = 0;
+  // exactly Blosum62 from fixed_kernels.h, AlignDouble then uses the
+  // kernels specialized for it
+  bool blosum62 = false;
 };
 
 class AlignmentEnvironments {
@@ -35,7 +46,9 @@ class AlignmentEnvironments {
   // no allow copy, iz bad
   AlignmentEnvironments(const AlignmentEnvironments& envs) = delete;
 
-  void EstimPam(char* seq1, char* seq2, int len, double result[3]) const;
+  // scratch is the caller's, EstimPam is called from all aligner threads
+  void EstimPam(char* seq1, char* seq2, int len, double result[3],
+                PamScratch* scratch) const;
   const AlignmentEnvironment& FindNearest(double pam) const;
   const AlignmentEnvironment& LogPamEnv() const;
   const AlignmentEnvironment& JustScoreEnv() const;
@@ -54,6 +67,8 @@ class AlignmentEnvironments {
                          std::vector<double*>& matrices);
   std::vector<AlignmentEnvironment> envs_;
   DayMatrix* day_matrices_;
+  // day_matrices_ transposed, for scoring under all of them at once
+  DayMatrixTable* day_table_;
   // double* logpam1_matrix_;
   AlignmentEnvironment logpam_env_;
   AlignmentEnvironment just_score_env_;
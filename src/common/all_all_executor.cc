@@ -20,23 +20,14 @@ using std::string;
 using namespace std::literals::chrono_literals;
 
 void AllAllExecutor::EnqueueAlignment(const WorkItem& item) {
-  if (!work_queue_->push(item)) {
-    cout << "failed to push work item to queue.\n";
-  }
+  scheduler_->Submit(&group_, [this, item]() { Align(item); });
 }
 
 void AllAllExecutor::FinishAndOutput(const string& output_dir) {
   cout << "waiting for work queue to empty\n";
-  while (!work_queue_->empty()) {
-    std::this_thread::sleep_for(1s);
-    // cout << "work queue has " << work_queue_->size() << " entries left\n";
-  }
-  // cout << "Queue emptied, unblocking...\n";
+  // helps with the alignments left
+  scheduler_->Wait(&group_);
   run_ = false;
-  work_queue_->unblock();
-  for (auto& f : threads_) {
-    f.join();
-  }
   queue_measure_thread_.join();
   cout << "All threads finished.\n";
 
@@ -147,6 +138,8 @@ void AllAllExecutor::FinishAndOutput(const string& output_dir) {
   cout << "Total All-All full alignments: " << num_full_alignments_.load()
        << "\n";
   cout << "Total threshold alignments: " << num_pass_threshold_.load() << "\n";
+  cout << "Total pairs skipped by score bound: " << num_bound_skipped_.load()
+       << "\n";
 
   // queue size stats
   std::vector<std::pair<size_t, size_t>> values;
@@ -162,16 +155,20 @@ void AllAllExecutor::FinishAndOutput(const string& output_dir) {
   o << std::setw(2) << j << std::endl;
 }
 
-AllAllExecutor::AllAllExecutor(size_t num_threads, size_t capacity,
+AllAllExecutor::AllAllExecutor(TaskScheduler* scheduler, size_t capacity,
                                AlignmentEnvironments* envs,
-                               const Parameters* params)
-    : envs_(envs), params_(params), num_threads_(num_threads) {
-  work_queue_.reset(new ConcurrentQueue<WorkItem>(capacity));
-  matches_per_thread_.resize(num_threads);
+                               const Parameters* params,
+                               PairCache* pair_cache)
+    : scheduler_(scheduler),
+      group_(capacity, TaskScheduler::TaskGroup::Kind::kLeaf),
+      envs_(envs),
+      params_(params),
+      pair_cache_(pair_cache) {
+  matches_per_thread_.resize(scheduler->NumThreads());
+  aligners_.resize(scheduler->NumThreads());
 
   // cout << "Start executor, id is " << id_.load() << "\n";
 
-  num_active_threads_ = num_threads;
   timestamps_.reserve(100000);
   queue_sizes_.reserve(100000);
 
@@ -181,16 +178,9 @@ AllAllExecutor::AllAllExecutor(size_t num_threads, size_t capacity,
     while (run_) {
       time_t result = std::time(nullptr);
       timestamps_.push_back(static_cast<long int>(result));
-      queue_sizes_.push_back(work_queue_->size());
+      queue_sizes_.push_back(scheduler_->NumQueued(&group_));
       std::this_thread::sleep_for(std::chrono::milliseconds(500));
     }
     // cout << "queue measure thread finished\n";
   });
 }
-
-void AllAllExecutor::Initialize() {
-  threads_.reserve(num_threads_);
-  for (size_t i = 0; i < num_threads_; i++) {
-    threads_.push_back(std::thread(&AllAllExecutor::Worker, this));
-  }
-}
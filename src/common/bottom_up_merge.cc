@@ -1,6 +1,10 @@
 
 #include "bottom_up_merge.h"
+#include <algorithm>
+#include <atomic>
+#include <functional>
 #include <iostream>
+#include <map>
 
 using std::cout;
 using std::string;
@@ -18,14 +22,12 @@ BottomUpMerge::BottomUpMerge(std::vector<std::unique_ptr<Dataset>>& datasets,
     auto s = dataset->GetNextRecord(&data, &size);
     uint32_t genome_index = 0;
     while (s.ok()) {
-      if (size > 60000) {
-        cout << "over size " << size << "\n";
-        exit(0);
-      }
       Sequence seq(absl::string_view(data, size),
                    dataset->Name(), dataset->Size(), genome_index++, id++);
+      ProteinAligner::SetScoreBounds(*aligner->Envs(), &seq);
+      KmerFilter::SetKmers(aligner->Params()->kmer_size, &seq);
 
-      sequences_.push_back(seq);
+      sequences_.push_back(std::move(seq));
 
       s = dataset->GetNextRecord(&data, &size);
     }
@@ -60,13 +62,11 @@ BottomUpMerge::BottomUpMerge(
     uint32_t genome_index_old = 0;
     while (s_old.ok()) {
       // cout << "Adding sequence id " << id << "\n";
-      if (size_old > 60000) {
-        cout << "over size " << size_old << "\n";
-        exit(0);
-      }
 
       Sequence seq(absl::string_view(data_old, size_old), dataset_old->Name(),
                    dataset_old->Size(), genome_index_old++, id_old++);
+      ProteinAligner::SetScoreBounds(*aligner->Envs(), &seq);
+      KmerFilter::SetKmers(aligner->Params()->kmer_size, &seq);
 
       sequences_.push_back(std::move(seq));
       s_old = dataset_old->GetNextRecord(&data_old, &size_old);
@@ -99,14 +99,12 @@ BottomUpMerge::BottomUpMerge(
       // coverages_.back().resize(size);
 
       // cout << "Adding sequence id " << id << "\n";
-      if (size > 60000) {
-        cout << "over size " << size << "\n";
-        exit(0);
-      }
       Sequence seq(absl::string_view(data, size),  // coverages_.back(),
                    dataset->Name(), dataset->Size(), genome_index++, id++);
+      ProteinAligner::SetScoreBounds(*aligner->Envs(), &seq);
+      KmerFilter::SetKmers(aligner->Params()->kmer_size, &seq);
 
-      sequences_.push_back(seq);
+      sequences_.push_back(std::move(seq));
       /*ClusterSet cs(seq);
 
       sets_.push_back(std::move(cs));*/
@@ -129,123 +127,159 @@ void BottomUpMerge::DebugDump() {
 }
 
 agd::Status BottomUpMerge::RunMulti(
-    size_t num_threads, size_t dup_removal_threshold, AllAllExecutor* executor,
+    TaskScheduler* scheduler, size_t dup_removal_threshold,
+    SetPairing::Policy policy, float max_imbalance, AllAllExecutor* executor,
     MergeExecutor* merge_executor, bool do_allall,
     std::vector<std::string>& dataset_file_names) {
-  cluster_sets_left_ = sets_.size();
-
-  // launch threads, join threads
-  auto cluster_worker = [this, &merge_executor, &dup_removal_threshold]() {
-    // cout << "cluster worker starting\n";
-    // need own aligner per thread
-    ProteinAligner aligner(aligner_->Envs(), aligner_->Params());
-
-    // is atomic actually needed here?
-    while (cluster_sets_left_.load() > 1) {
-      queue_mu_.Lock();
-      if (sets_.size() > 1 && cluster_sets_left_.load() > 1) {  // enough to pop
-        auto s1 = std::move(sets_.front());
-        sets_.pop_front();
-        auto s2 = std::move(sets_.front());
-        sets_.pop_front();
-        cluster_sets_left_.fetch_sub(1);
-        // cout << "cluster sets left: " << cluster_sets_left_.load() << "\n";
-        queue_mu_.Unlock();
-
-        // this part takes a while for larger sets
-        auto t0 = std::chrono::high_resolution_clock::now();
-
-        // eventually we may want to call single thread mergeClusters for
-        // small cluster sets as it may be more efficient
-
-        // swap so we have the larger set first, this results
-        // in a larger number of smaller work items
-        if (s1.Size() < s2.Size()) {
-          s1.Swap(&s2);
-          // cout << "swapped89\n";
-        }
-
-        auto merged_set = s1.MergeClustersParallel(s2, merge_executor);
-        auto t1 = std::chrono::high_resolution_clock::now();
-
-        auto duration = t1 - t0;
-        auto sec = std::chrono::duration_cast<std::chrono::seconds>(duration);
-        // cout << "merge took: " << sec.count() << " seconds.\n";
-
-        if (merged_set.Size() > dup_removal_threshold) {
-          merged_set.RemoveDuplicates();
-        }
-
-        queue_mu_.Lock();
-        sets_.push_back(std::move(merged_set));
-        queue_pop_cv_.SignalAll();
-        queue_mu_.Unlock();
-
-      } else if (sets_.size() <= 1) {  // wait until enough
-        while (sets_.size() <= 1 && cluster_sets_left_.load() > 1) {
-          /*cout << "waiting, set size: " << sets_.size()
-               << " sets left: " << cluster_sets_left_.load() << "\n";*/
-          queue_pop_cv_.Wait(&queue_mu_);
-        }
-        if (cluster_sets_left_.load() <= 1) {
-          queue_mu_.Unlock();
-          break;
-        }
-
-        auto s1 = std::move(sets_.front());
-        sets_.pop_front();
-        auto s2 = std::move(sets_.front());
-        sets_.pop_front();
-        cluster_sets_left_.fetch_sub(1);
-        // cout << "cluster sets left: " << cluster_sets_left_.load() << "\n";
-        queue_mu_.Unlock();
-
-        // swap so we have the larger set first, this results
-        // in a larger number of smaller work items
-        if (s1.Size() < s2.Size()) {
-          s1.Swap(&s2);
-          // cout << "swapped127\n";
-        }
-
-        // this part takes a while for larger sets
-        auto t0 = std::chrono::high_resolution_clock::now();
-        auto merged_set = s1.MergeClustersParallel(s2, merge_executor);
-        auto t1 = std::chrono::high_resolution_clock::now();
-
-        auto duration = t1 - t0;
-        auto sec = std::chrono::duration_cast<std::chrono::seconds>(duration);
-        // cout << "merge took: " << sec.count() << " seconds.\n";
-
-        if (merged_set.Size() > dup_removal_threshold) {
-          merged_set.RemoveDuplicates();
-        }
-
-        queue_mu_.Lock();
-        sets_.push_back(std::move(merged_set));
-        queue_pop_cv_.SignalAll();
-        queue_mu_.Unlock();
-
-      } else {  // only one cluster set left, done.
-        queue_mu_.Unlock();
-        break;
-      }
+  typedef std::chrono::high_resolution_clock Clock;
+  // set merges that produced sets of one depth in the merge tree
+  struct Level {
+    size_t merges = 0;
+    double merge_seconds = 0;  // summed over the merges
+    Clock::time_point start;   // of the first merge
+    Clock::time_point end;     // of the last
+  };
+
+  // a pair of sets is taken from pairing as soon as it gives one, and a set
+  // merge task merges the pair and pushes the result back. the merges of a
+  // task are tiles of the same scheduler, which the task runs itself while
+  // it waits for them, along with tiles of the other merges
+  SetPairing pairing(policy, max_imbalance);
+  for (auto& set : sets_) {
+    pairing.Push(std::make_unique<ClusterSet>(std::move(set)), 0);
+  }
+  sets_.clear();
+
+  TaskScheduler::TaskGroup set_merges;
+  size_t num_running = 0;
+  std::map<int, Level> levels;
+
+  // the merges form a DAG whose edges are made as sets become ready. once
+  // one merge is running and one set waits for it (or old_set_ waits for
+  // the last merge), the merge after it has a known partner. idle threads
+  // then compute its thresholds against the reps of the running merge's
+  // inputs, which include those of its result, ahead into the pair cache
+  TaskScheduler::TaskGroup prefetches(
+      0, TaskScheduler::TaskGroup::Kind::kBackground);
+  // rep sequences of the inputs of the running merges, by merge number
+  std::map<uint64_t, std::shared_ptr<const std::vector<const Sequence*>>>
+      running_reps;
+  uint64_t num_merges = 0;
+  // set once the merge a prefetch is for starts, the last is current
+  std::deque<std::atomic<bool>> prefetch_cancelled;
+  // queue_mu_ must be held
+  auto prefetch = [&]() {
+    if (!merge_executor->CanPrefetch() || num_running != 1) {
+      return;
+    }
+    std::shared_ptr<std::vector<const Sequence*>> queries;
+    if (pairing.Size() == 1) {
+      queries = std::make_shared<std::vector<const Sequence*>>(
+          pairing.PeekLast()->RepSequences());
+    } else if (pairing.Size() == 0 && old_set_.Size() >= 1) {
+      queries = std::make_shared<std::vector<const Sequence*>>(
+          old_set_.RepSequences());
+    } else {
+      return;
+    }
+    prefetch_cancelled.emplace_back(false);
+    merge_executor->EnqueuePrefetch(&prefetches, queries,
+                                    running_reps.begin()->second,
+                                    &prefetch_cancelled.back());
+  };
+
+  std::function<void()> submit_merges;
+  auto set_merge = [&](std::shared_ptr<ClusterSet> s1,
+                       std::shared_ptr<ClusterSet> s2, int depth,
+                       uint64_t merge) {
+    auto start = Clock::now();
+    // swap so we have the larger set first, this results
+    // in a larger number of smaller work items
+    if (s1->Size() < s2->Size()) {
+      s1->Swap(s2.get());
     }
 
-    // cout << "Cluster eval thread finishing...\n";
+    // this part takes a while for larger sets
+    auto merged_set = std::make_unique<ClusterSet>(
+        s1->MergeClustersParallel(*s2, merge_executor));
+    s1.reset();
+    s2.reset();
+
+    if (merged_set->Size() > dup_removal_threshold) {
+      merged_set->RemoveDuplicates();
+    }
+    auto end = Clock::now();
+
+    queue_mu_.Lock();
+    auto& level = levels[depth];
+    if (level.merges++ == 0 || start < level.start) {
+      level.start = start;
+    }
+    level.end = std::max(level.end, end);
+    level.merge_seconds +=
+        std::chrono::duration<double>(end - start).count();
+    running_reps.erase(merge);
+    if (!prefetch_cancelled.empty()) {
+      prefetch_cancelled.back() = true;
+    }
+    pairing.Push(std::move(merged_set), depth);
+    num_running--;
+    submit_merges();
+    prefetch();
+    queue_mu_.Unlock();
+  };
+  // queue_mu_ must be held
+  submit_merges = [&]() {
+    std::unique_ptr<ClusterSet> s1, s2;
+    int depth;
+    while (pairing.Pop(num_running, &s1, &s2, &depth)) {
+      num_running++;
+      uint64_t merge = num_merges++;
+      if (merge_executor->CanPrefetch()) {
+        auto reps = s1->RepSequences();
+        auto reps2 = s2->RepSequences();
+        reps.insert(reps.end(), reps2.begin(), reps2.end());
+        running_reps[merge] =
+            std::make_shared<const std::vector<const Sequence*>>(
+                std::move(reps));
+      }
+      // std::function needs a copyable task
+      std::shared_ptr<ClusterSet> p1(std::move(s1)), p2(std::move(s2));
+      scheduler->Submit(&set_merges,
+                        [&set_merge, p1, p2, depth, merge]() mutable {
+                          set_merge(std::move(p1), std::move(p2), depth + 1,
+                                    merge);
+                        });
+    }
   };
 
-  cout << "Clustering " << cluster_sets_left_.load() << " sequences...\n";
+  cout << "Clustering " << pairing.Size() << " sequences...\n";
 
-  auto t0 = std::chrono::high_resolution_clock::now();
-  threads_.reserve(num_threads);
-  for (size_t i = 0; i < num_threads; i++) {
-    threads_.push_back(std::thread(cluster_worker));
-  }
+  auto t0 = Clock::now();
+  queue_mu_.Lock();
+  submit_merges();
+  prefetch();
+  queue_mu_.Unlock();
+  scheduler->Wait(&set_merges);
 
-  for (auto& t : threads_) {
-    t.join();
+  auto last = pairing.TakeLast();
+  if (last) {
+    sets_.push_back(std::move(*last));
+  }
+  cout << "Merge tree depth: " << (levels.empty() ? 0 : levels.rbegin()->first)
+       << "\n";
+  for (const auto& level : levels) {
+    cout << "Level " << level.first << ": " << level.second.merges
+         << " merges, " << level.second.merge_seconds << " s merging, "
+         << std::chrono::duration<double>(level.second.end -
+                                          level.second.start)
+                .count()
+         << " s wall\n";
   }
 
+  if (!prefetch_cancelled.empty()) {
+    prefetch_cancelled.back() = true;
+  }
   if (old_set_.Size() >= 1) {
     std::cout << "Merging data of older set with the new result ...\n";
     auto s1 = std::move(sets_.front());
@@ -253,6 +287,8 @@ agd::Status BottomUpMerge::RunMulti(
     auto merged_set = s1.MergeClustersParallel(old_set_, merge_executor);
     sets_.push_back(std::move(merged_set));
   }
+  // the cancelled prefetches left return right away
+  scheduler->Wait(&prefetches);
 
   auto t1 = std::chrono::high_resolution_clock::now();
 
@@ -7,6 +7,8 @@
 #include "all_all_executor.h"
 #include "cluster_set.h"
 #include "merge_executor.h"
+#include "set_pairing.h"
+#include "task_scheduler.h"
 #include "src/dataset/dataset.h"
 
 class BottomUpMerge {
@@ -27,8 +29,10 @@ class BottomUpMerge {
   agd::Status Run(AllAllExecutor* executor, size_t dup_removal_threshold,
                   bool do_allall, std::vector<std::string>& dataset_file_names);
 
-  // use multiple threads to merge clusters in parallel
-  agd::Status RunMulti(size_t num_threads, size_t dup_removal_threshold,
+  // merge clusters in parallel, set merges are tasks of scheduler. pairing
+  // picks which two sets are merged next, see SetPairing
+  agd::Status RunMulti(TaskScheduler* scheduler, size_t dup_removal_threshold,
+                       SetPairing::Policy pairing, float max_imbalance,
                        AllAllExecutor* executor, MergeExecutor* merge_executor,
                        bool do_allall,
                        std::vector<std::string>& dataset_file_names);
@@ -39,17 +43,12 @@ class BottomUpMerge {
   std::deque<ClusterSet> sets_;
   ClusterSet old_set_;
 
-  // threads to run cluster mergers in parallel
-  std::vector<std::thread> threads_;
-
   // aligner object
   ProteinAligner* aligner_;
 
   // sequences
   std::vector<Sequence> sequences_;
 
-  // mutex and sync vars
+  // protects the sets left to merge while merging in parallel
   absl::Mutex queue_mu_;
-  std::atomic<uint32_t> cluster_sets_left_;
-  mutable absl::CondVar queue_pop_cv_;
 };
@@ -1,5 +1,6 @@
 
 #include "cluster.h"
+#include <algorithm>
 #include <iostream>
 
 agd::Status Cluster::AlignReps(const Cluster& other,
@@ -8,103 +9,112 @@ agd::Status Cluster::AlignReps(const Cluster& other,
   const auto& this_rep = seqs_.front();
   const auto& other_rep = other.seqs_.front();
 
-  return aligner->AlignSingle(all_seqs_->at(this_rep).Seq().data(), all_seqs_->at(other_rep).Seq().data(),
-                              all_seqs_->at(this_rep).Seq().size(), all_seqs_->at(other_rep).Seq().size(),
-                              *alignment);
+  return aligner->AlignSingle(all_seqs_->at(this_rep),
+                              all_seqs_->at(other_rep), *alignment);
 }
 
 bool Cluster::PassesThreshold(const Cluster& other, ProteinAligner* aligner) {
   const auto& this_rep = seqs_.front();
   const auto& other_rep = other.seqs_.front();
+  if (!aligner->MayPassThreshold(all_seqs_->at(this_rep),
+                                 all_seqs_->at(other_rep))) {
+    return false;
+  }
 
-  return aligner->PassesThreshold(all_seqs_->at(this_rep).Seq().data(), all_seqs_->at(other_rep).Seq().data(),
-                              all_seqs_->at(this_rep).Seq().size(), all_seqs_->at(other_rep).Seq().size());
+  // this rep is usually the query for a whole merge work item
+  const auto& profile = aligner->Profiles().Get(
+      this_rep, all_seqs_->at(this_rep).Seq().data(),
+      all_seqs_->at(this_rep).Seq().size());
+  return aligner->PassesThreshold(profile, all_seqs_->at(this_rep),
+                                  all_seqs_->at(other_rep));
+}
+
+bool Cluster::Contains(uint32_t seq) const {
+  if (seqs_.size() >= kHashedMembers) {
+    return members_.contains(seq);
+  }
+  return std::find(seqs_.begin(), seqs_.end(), seq) != seqs_.end();
+}
+
+void Cluster::Insert(uint32_t seq) {
+  seqs_.push_back(seq);
+  if (seqs_.size() > kHashedMembers) {
+    members_.insert(seq);
+  } else if (seqs_.size() == kHashedMembers) {
+    members_.insert(seqs_.begin(), seqs_.end());
+  }
 }
 
 void Cluster::AddSequence(uint32_t seq) {
   // make sure we aren't adding duplicate
-  bool found = false;
-  for (const auto& s : seqs_) {
-    if (s == seq){
-      found = true;
-      break;
-    }
+  if (!Contains(seq)) {
+    Insert(seq);
   }
-  if (!found) {
-    seqs_.push_back(seq);
+}
+
+void Cluster::AbsorbCluster(const Cluster& other) {
+  const auto& other_seqs = other.Sequences();
+  size_t max_size = seqs_.size() + other_seqs.size();
+  seqs_.reserve(max_size);
+  if (max_size >= kHashedMembers) {
+    members_.reserve(max_size);
+  }
+  for (const auto& seq : other_seqs) {
+    AddSequence(seq);
   }
 }
 
 void Cluster::Merge(Cluster* other, ProteinAligner* aligner) {
   const auto& other_seqs = other->Sequences();
-  //seqs_.push_back(other_seqs.front());  // the rep matches, or we wouldnt be here
-  bool found = false;
-  for (const auto& s : seqs_) {
-    if (s == other_seqs.front()) {
-      found = true;
-      break;
-    }
-  }
-  if (!found) {
-    seqs_.push_back(other_seqs.front());  // the rep matches, or we wouldnt be here
-  } 
+  // the rep matches, or we wouldnt be here
+  AddSequence(other_seqs.front());
 
-  bool first = true;  // to skip first
-  for (const auto& seq : other_seqs) {
-    if (first) {
-      first = false;
-      continue;
-    }
-    const auto& rep = seqs_.front();
-    bool found = false;
-    for (const auto& s : seqs_) {
-      if (s == seq) {
-        found = true;
-        break;
-      }
-    }
-    if (!found) {
-      if (aligner->PassesThreshold(all_seqs_->at(rep).Seq().data(), all_seqs_->at(seq).Seq().data(),
-                                   all_seqs_->at(rep).Seq().size(), all_seqs_->at(seq).Seq().size())) {
-        seqs_.push_back(seq);
-      }
-    }
-  }
+  AddPassingSeqs(other_seqs, aligner);
 
   other->MergeOther(this, aligner);
 }
 
 void Cluster::MergeOther(Cluster* other, ProteinAligner* aligner) {
   const auto& other_seqs = other->Sequences();
-  bool found = false;
-  for (const auto& s : seqs_) {
-    if (s == other_seqs.front()) {
-      found = true;
-      break;
-    }
-  }
-  if (!found) {
-    seqs_.push_back(other_seqs.front());  // the rep matches, or we wouldnt be here
-  } 
+  // the rep matches, or we wouldnt be here
+  AddSequence(other_seqs.front());
+
+  AddPassingSeqs(other_seqs, aligner);
+}
 
+void Cluster::AddPassingSeqs(const std::vector<uint32_t>& other_seqs,
+                             ProteinAligner* aligner) {
+  // seqs of a cluster are unique, so adding one does not change whether
+  // the others are found. collect them first to align in batches
+  const uint32_t rep = seqs_.front();
+  std::vector<uint32_t> candidates;
   bool first = true;  // to skip first
   for (const auto& seq : other_seqs) {
     if (first) {
       first = false;
       continue;
     }
-    const auto& rep = seqs_.front();
-    bool found = false;
-    for (const auto& s : seqs_) {
-      if (s == seq) {
-        found = true;
-        break;
-      }
+    if (!Contains(seq) &&
+        aligner->MayPassThreshold(all_seqs_->at(rep), all_seqs_->at(seq))) {
+      candidates.push_back(seq);
+    }
+  }
+
+  const auto& rep_profile = aligner->Profiles().Get(
+      rep, all_seqs_->at(rep).Seq().data(), all_seqs_->at(rep).Seq().size());
+  const Sequence* targets[ProteinAligner::kMaxBatch];
+  for (size_t start = 0; start < candidates.size();
+       start += ProteinAligner::kMaxBatch) {
+    int n = std::min(candidates.size() - start,
+                     size_t(ProteinAligner::kMaxBatch));
+    for (int i = 0; i < n; i++) {
+      targets[i] = &all_seqs_->at(candidates[start + i]);
     }
-    if (!found) {
-      if (aligner->PassesThreshold(all_seqs_->at(rep).Seq().data(), all_seqs_->at(seq).Seq().data(),
-                                   all_seqs_->at(rep).Seq().size(), all_seqs_->at(seq).Seq().size())) {
-        seqs_.push_back(seq);
+    uint64_t passes = aligner->PassesThresholdBatch(
+        rep_profile, all_seqs_->at(rep), targets, n);
+    for (int i = 0; i < n; i++) {
+      if (passes & (uint64_t(1) << i)) {
+        Insert(candidates[start + i]);
       }
     }
   }
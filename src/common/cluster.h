@@ -1,6 +1,7 @@
 #pragma once
 
 #include <list>
+#include "absl/container/flat_hash_set.h"
 #include "src/agd/errors.h"
 #include "aligner.h"
 #include "sequence.h"
@@ -15,6 +16,7 @@ class Cluster {
   Cluster(Cluster&& other) noexcept {
     all_seqs_ = other.all_seqs_;
     seqs_ = std::move(other.seqs_);
+    members_ = std::move(other.members_);
     fully_merged_ = other.fully_merged_;
     duplicate_ = other.duplicate_;
   }
@@ -22,6 +24,7 @@ class Cluster {
   Cluster& operator=(Cluster&& other) noexcept {
     all_seqs_ = other.all_seqs_;
     seqs_ = std::move(other.seqs_);
+    members_ = std::move(other.members_);
     fully_merged_ = other.fully_merged_;
     duplicate_ = other.duplicate_;
     return *this;
@@ -54,6 +57,13 @@ class Cluster {
   // add seq into seqs_
   void AddSequence(uint32_t seq);
 
+  // true if seq is in this cluster
+  bool Contains(uint32_t seq) const;
+
+  // add the seqs of other, rep included, that are not in this cluster,
+  // e.g. when other is fully merged into this one
+  void AbsorbCluster(const Cluster& other);
+
   // mark that this cluster has been fully merged
   // with another, and will go away. seqs_ may not be valid anymore
   void SetFullyMerged() { fully_merged_ = true; }
@@ -76,11 +86,23 @@ class Cluster {
   uint32_t ByteSize() { return sizeof(bool) + sizeof(int) + sizeof(int)*seqs_.size(); }
 
  private:
+  // append seq, which is not in this cluster
+  void Insert(uint32_t seq);
+
+  // add the seqs of other_seqs, but the first (its rep), that are not in
+  // this cluster and pass the threshold against our rep
+  void AddPassingSeqs(const std::vector<uint32_t>& other_seqs,
+                      ProteinAligner* aligner);
+
   // representative is first seq
   // use a list so refs aren't invalidated
   // NOTE testing vector here for dist version mem consumption
   // TODO have a base cluster class and inherit versions for dist and local?
   std::vector<uint32_t> seqs_;
+  // seqs_ is scanned by Contains while it is short, from kHashedMembers
+  // seqs on members_ holds them as well
+  static const size_t kHashedMembers = 64;
+  absl::flat_hash_set<uint32_t> members_;
   const std::vector<Sequence>* all_seqs_ = nullptr;
   bool fully_merged_ = false;
   bool duplicate_ = false;
@@ -4,6 +4,7 @@
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <memory>
 #include "absl/container/flat_hash_set.h"
 #include "aligner.h"
 #include "candidate_map.h"
@@ -171,15 +172,48 @@ ClusterSet ClusterSet::MergeClustersParallel(ClusterSet& other,
                                              MergeExecutor* executor) {
   ClusterSet new_cluster_set(clusters_.size() + other.clusters_.size());
 
-  MultiNotification n;
+  // rep residues of other before each cluster, a row of rep length len is
+  // cut every kMergeTileCells / len residues. tiles are whole batch kernel
+  // blocks so the batches stay full
+  std::vector<uint64_t> residues(other.clusters_.size() + 1, 0);
+  std::vector<const Sequence*> other_reps(other.clusters_.size());
+  for (size_t i = 0; i < other.clusters_.size(); i++) {
+    other_reps[i] = &other.clusters_[i].SeqRep();
+    residues[i + 1] = residues[i] + other_reps[i]->Seq().size();
+  }
+  const size_t block = Profile::BatchWidth();
+
+  auto tiles = executor->NewGroup();
+  // tile state, must outlive the work items
+  std::vector<std::unique_ptr<MergeRow>> rows;
+  rows.reserve(clusters_.size());
   for (auto& c : clusters_) {
-    // enqueue each comparison between c and all cluster in other
-    MergeExecutor::WorkItem item = make_tuple(&c, &other, &n);
-    executor->EnqueueMerge(item);
+    rows.emplace_back(new MergeRow);
+    auto* row = rows.back().get();
+    row->cluster = &c;
+    row->rep = c.Rep();
+    row->seq_rep = &c.SeqRep();
+    row->other = &other;
+    row->other_reps = &other_reps;
+    uint64_t tile_residues = std::max<uint64_t>(
+        1, kMergeTileCells / std::max<size_t>(1, c.SeqRep().Seq().size()));
+    row->tile_starts.push_back(0);
+    for (size_t i = block; i < other.clusters_.size(); i += block) {
+      if (residues[i] - residues[row->tile_starts.back()] >= tile_residues) {
+        row->tile_starts.push_back(i);
+      }
+    }
+    row->tile_starts.push_back(other.clusters_.size());
+    row->passes.resize(row->NumTiles());
+    row->computed.resize(row->NumTiles(), false);
+
+    // enqueue each comparison between c and a tile of clusters in other
+    for (size_t tile = 0; tile < row->NumTiles(); tile++) {
+      executor->EnqueueMerge(&tiles, make_tuple(row, tile));
+    }
   }
 
-  n.SetMinNotifies(clusters_.size());
-  n.WaitForNotification();
+  executor->Wait(&tiles);
 
   for (auto& c_other : other.clusters_) {
     if (!c_other.IsFullyMerged()) {
@@ -205,17 +239,152 @@ ClusterSet ClusterSet::MergeClustersParallel(ClusterSet& other,
   return new_cluster_set;
 }
 
-void ClusterSet::MergeClusterLocked(Cluster* cluster, ProteinAligner* aligner) {
+std::vector<const Sequence*> ClusterSet::RepSequences() const {
+  std::vector<const Sequence*> reps;
+  reps.reserve(clusters_.size());
+  for (const auto& c : clusters_) {
+    if (!c.IsFullyMerged()) {
+      reps.push_back(&c.SeqRep());
+    }
+  }
+  return reps;
+}
+
+void ClusterSet::MergeTile(MergeRow* row, size_t tile,
+                           ProteinAligner* aligner) {
+  // a row cluster is only merged by its own row, so tiles of different rows
+  // run in parallel like whole rows did
+  row->mu.Lock();
+  bool merge_now =
+      !row->merging && !row->done.load() && row->next_merged == tile;
+  if (merge_now) {
+    row->merging = true;
+  }
+  row->mu.Unlock();
+
+  std::vector<bool> passes;
+  bool ended = false;
+  if (merge_now) {
+    // next in line, thresholds and merges block by block like a whole row
+    ended = MergeTilePassing(*row, row->tile_starts[tile],
+                             row->tile_starts[tile + 1], nullptr, aligner);
+  } else if (!row->done.load()) {
+    // a full merge before this tile makes its thresholds useless, they are
+    // only computed ahead while none is known
+    TilePasses(*row, row->tile_starts[tile],
+               row->tile_starts[tile + 1], aligner, &passes);
+  }
+
+  row->mu.Lock();
+  row->computed[tile] = true;
+  if (merge_now) {
+    row->done = ended;
+    row->next_merged++;
+  } else {
+    row->passes[tile] = std::move(passes);
+  }
+  if (merge_now || !row->merging) {
+    // apply the merges of the tiles computed ahead, in order. tiles
+    // finishing in the meantime leave theirs to this thread
+    row->merging = true;
+    while (!row->done.load() && row->next_merged < row->NumTiles() &&
+           row->computed[row->next_merged]) {
+      size_t t = row->next_merged;
+      row->mu.Unlock();
+      ended = MergeTilePassing(*row, row->tile_starts[t],
+                               row->tile_starts[t + 1], &row->passes[t],
+                               aligner);
+      row->mu.Lock();
+      row->passes[t].clear();
+      row->done = ended;
+      row->next_merged++;
+    }
+    row->merging = false;
+  }
+  row->mu.Unlock();
+
+  // rep profiles are only reused within one work item
+  aligner->Profiles().Clear();
+}
+
+size_t ClusterSet::BlockPasses(const MergeRow& row, size_t start, size_t end,
+                               ProteinAligner* aligner, bool* passes) {
+  // thresholds are computed for a block of reps at once, one per SIMD lane.
+  // reps don't change, so a result stays valid if c_other is fully merged
+  // before we get to it, that is rechecked when merging
+  const Sequence& seq_rep = *row.seq_rep;
+  const auto& profile = aligner->Profiles().Get(
+      row.rep, seq_rep.Seq().data(), seq_rep.Seq().size());
+  const int width = Profile::BatchWidth();
+  const Sequence* targets[ProteinAligner::kMaxBatch];
+  size_t target_idx[ProteinAligner::kMaxBatch];
+  int n = 0;
+  size_t block_end;
+  for (block_end = start; block_end < end && n < width &&
+                          block_end - start < ProteinAligner::kMaxBatch;
+       block_end++) {
+    passes[block_end - start] = false;
+    const Sequence* other_rep = (*row.other_reps)[block_end];
+    if (!clusters_[block_end].IsFullyMerged() &&
+        aligner->MayPassThreshold(seq_rep, *other_rep)) {
+      targets[n] = other_rep;
+      target_idx[n++] = block_end - start;
+    }
+  }
+  uint64_t bits = aligner->PassesThresholdBatch(profile, seq_rep, targets, n);
+  for (int k = 0; k < n; k++) {
+    passes[target_idx[k]] = bits & (uint64_t(1) << k);
+  }
+  return block_end;
+}
+
+void ClusterSet::TilePasses(const MergeRow& row, size_t start, size_t end,
+                            ProteinAligner* aligner,
+                            std::vector<bool>* passes) {
+  passes->resize(end - start);
+  bool block_passes[ProteinAligner::kMaxBatch];
+  size_t block_end;
+  for (size_t i = start; i < end; i = block_end) {
+    block_end = BlockPasses(row, i, end, aligner, block_passes);
+    for (size_t k = i; k < block_end; k++) {
+      (*passes)[k - start] = block_passes[k - i];
+    }
+  }
+}
+
+bool ClusterSet::MergeTilePassing(const MergeRow& row, size_t start,
+                                  size_t end,
+                                  const std::vector<bool>* tile_passes,
+                                  ProteinAligner* aligner) {
   // this func called from multiple threads, but we are guaranteed that
   // `cluster` is accessed exclusively clusters of `this` must be locked before
   // modifying, because other threads may be accessing
+  Cluster* cluster = row.cluster;
   agd::Status s;
   ProteinAligner::Alignment alignment;
-  for (auto& c_other : clusters_) {
-    if (!c_other.IsFullyMerged() &&
-        cluster->PassesThreshold(c_other, aligner)) {
+  bool passes[ProteinAligner::kMaxBatch];
+  size_t block_start = start, block_end = start;
+
+  for (size_t i = start; i < end; i++) {
+    auto& c_other = clusters_[i];
+    if (c_other.IsFullyMerged()) {
+      continue;
+    }
+    bool pass;
+    if (tile_passes) {
+      pass = (*tile_passes)[i - start];
+    } else {
+      if (i >= block_end) {
+        block_start = i;
+        block_end = BlockPasses(row, i, end, aligner, passes);
+      }
+      pass = passes[i - block_start];
+    }
+
+    if (pass) {
       // std::cout << "passed threshold, aligning ...\n";
-      s = cluster->AlignReps(c_other, &alignment, aligner);
+      const Sequence& other_rep = *(*row.other_reps)[i];
+      s = aligner->AlignSingle(*row.seq_rep, other_rep, alignment);
 
       // situation is :
       // |-------------------|
@@ -225,9 +394,9 @@ void ClusterSet::MergeClusterLocked(Cluster* cluster, ProteinAligner* aligner) {
       // add matching seqs from one to the other
       // std::cout << "reps are partially overlapped\n";
 
-      auto c_num_uncovered = cluster->SeqRep().Seq().size() -
+      auto c_num_uncovered = row.seq_rep->Seq().size() -
                              (alignment.seq1_max - alignment.seq1_min);
-      auto c_other_num_uncovered = c_other.SeqRep().Seq().size() -
+      auto c_other_num_uncovered = other_rep.Seq().size() -
                                    (alignment.seq2_max - alignment.seq2_min);
 
       if (c_num_uncovered < aligner->Params()->max_n_aa_not_covered &&
@@ -242,12 +411,10 @@ void ClusterSet::MergeClusterLocked(Cluster* cluster, ProteinAligner* aligner) {
           c_other.Unlock();
           continue;
         }
-        for (const auto& seq : cluster->Sequences()) {
-          c_other.AddSequence(seq);
-        }
+        c_other.AbsorbCluster(*cluster);
         cluster->SetFullyMerged();
         c_other.Unlock();
-        break;
+        return true;
 
       } else if (c_other_num_uncovered <
                      aligner->Params()->max_n_aa_not_covered &&
@@ -260,12 +427,10 @@ void ClusterSet::MergeClusterLocked(Cluster* cluster, ProteinAligner* aligner) {
           c_other.Unlock();
           continue;
         }
-        for (const auto& seq : c_other.Sequences()) {
-          cluster->AddSequence(seq);
-        }
+        cluster->AbsorbCluster(c_other);
         c_other.SetFullyMerged();
         c_other.Unlock();
-        break;
+        return true;
       } else {
         // add c_other_rep into c
         // for each sequence in c_other, add if it matches c rep
@@ -281,6 +446,7 @@ void ClusterSet::MergeClusterLocked(Cluster* cluster, ProteinAligner* aligner) {
       }
     }  // if passes threshold
   }    // for c_other in clusters
+  return false;
 }
 
 ClusterSet ClusterSet::MergeClusters(ClusterSet& other,
@@ -319,9 +485,7 @@ ClusterSet ClusterSet::MergeClusters(ClusterSet& other,
           // they are _almost_ overlapped, merge completely
           // std::cout << "Nearly complete overlap, merging c into c_other,
           // score is " << alignment.score << "\n";
-          for (const auto& seq : c.Sequences()) {
-            c_other.AddSequence(seq);
-          }
+          c_other.AbsorbCluster(c);
           c.SetFullyMerged();
           break;
 
@@ -330,9 +494,7 @@ ClusterSet ClusterSet::MergeClusters(ClusterSet& other,
                    alignment.score > aligner->Params()->min_full_merge_score) {
           // std::cout << "Nearly complete overlap, merging c_other into c,
           // score is " << alignment.score << "\n";
-          for (const auto& seq : c_other.Sequences()) {
-            c.AddSequence(seq);
-          }
+          c.AbsorbCluster(c_other);
           c_other.SetFullyMerged();
         } else {
           // add c_other_rep into c
@@ -343,6 +505,7 @@ ClusterSet ClusterSet::MergeClusters(ClusterSet& other,
         }
       }  // if passes threshold
     }
+    aligner->Profiles().Clear();
     if (!c.IsFullyMerged()) {
       new_cluster_set.clusters_.push_back(std::move(c));
     }
@@ -410,9 +573,7 @@ ClusterSet ClusterSet::MergeCluster(Cluster& c_other, ProteinAligner* aligner,
         // they are _almost_ overlapped, merge completely
         // std::cout << "Nearly complete overlap, merging c into c_other,
         // score is " << alignment.score << "\n";
-        for (const auto& seq : c.Sequences()) {
-          c_other.AddSequence(seq);
-        }
+        c_other.AbsorbCluster(c);
         c_standin.SetFullyMerged();
         fully_merged = true;
       } else if (c_other_num_uncovered <
@@ -420,9 +581,7 @@ ClusterSet ClusterSet::MergeCluster(Cluster& c_other, ProteinAligner* aligner,
                  alignment.score > aligner->Params()->min_full_merge_score) {
         // std::cout << "Nearly complete overlap, merging c_other into c,
         // score is " << alignment.score << "\n";
-        for (const auto& seq : c_other.Sequences()) {
-          c_standin.AddSequence(seq);
-        }
+        c_standin.AbsorbCluster(c_other);
         c_other.SetFullyMerged();
         fully_merged = true;
       } else {
@@ -443,6 +602,7 @@ ClusterSet ClusterSet::MergeCluster(Cluster& c_other, ProteinAligner* aligner,
       }
     }  // if passes threshold
 
+    aligner->Profiles().Clear();
     new_cluster_set.clusters_.push_back(std::move(c_standin));
   }
 
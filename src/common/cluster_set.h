@@ -1,7 +1,9 @@
 
 #pragma once
 
+#include <atomic>
 #include <vector>
+#include "absl/synchronization/mutex.h"
 #include "all_all_executor.h"
 #include "cluster.h"
 #include "src/comms/requests.h"
@@ -12,6 +14,34 @@ class MergeExecutor;
 
 class ClusterSet {
  public:
+  // one cluster merging into another set, cut into tiles of that set's
+  // clusters so threads can share a large row. the thresholds of the tiles
+  // are computed in any order, their merges are applied tile after tile so
+  // a full merge still ends the row where it did before
+  struct MergeRow {
+    size_t NumTiles() const { return tile_starts.size() - 1; }
+
+    Cluster* cluster;
+    // rep of cluster, taken before any tile runs. the merging tile grows
+    // cluster's seqs_, so the others must not read the rep through it
+    uint32_t rep;
+    const Sequence* seq_rep;
+    ClusterSet* other;
+    // reps of other's clusters, taken the same way since other rows grow
+    // those clusters under their lock
+    const std::vector<const Sequence*>* other_reps;
+    // first cluster of other of each tile, then the number of clusters
+    std::vector<size_t> tile_starts;
+
+    absl::Mutex mu;  // protects the members below
+    // threshold outcome of each cluster of a tile, once computed
+    std::vector<std::vector<bool>> passes;
+    std::vector<bool> computed;
+    size_t next_merged = 0;   // tile whose merges are applied next
+    bool merging = false;     // a thread is applying merges
+    std::atomic<bool> done{false};  // a full merge ended the row
+  };
+
   ClusterSet() = default;
   ClusterSet(ClusterSet&& other) { clusters_ = std::move(other.clusters_); }
   ClusterSet(uint32_t seed, const std::vector<Sequence>& sequences) {
@@ -64,8 +94,9 @@ class ClusterSet {
   // Add by akash
   void AddCluster(Cluster& c) { clusters_.push_back(std::move(c)); }
 
-  // merge `this` with `cluster`, called from parallel merge executor
-  void MergeClusterLocked(Cluster* cluster, ProteinAligner* aligner);
+  // merge tile `tile` of `row` into `this`, called from the parallel merge
+  // executor. applies the merges of every row tile ready in order
+  void MergeTile(MergeRow* row, size_t tile, ProteinAligner* aligner);
 
   // schedule all-all alignments onto the executor threadpool
   void ScheduleAlignments(AllAllBase* executor, std::vector<Sequence>& sequences);
@@ -79,6 +110,30 @@ class ClusterSet {
 
   size_t Size() { return clusters_.size(); }
 
+  // rep sequences of the clusters not fully merged
+  std::vector<const Sequence*> RepSequences() const;
+
  private:
+  // threshold DP cells a merge tile is cut to, some ms of work
+  static const uint64_t kMergeTileCells = 1 << 23;
+
+  // threshold outcome of the row's rep against the reps of clusters_ from
+  // start on, for up to a batch kernel call of those before end that are
+  // not fully merged, false for the others. returns the end of the block
+  size_t BlockPasses(const MergeRow& row, size_t start, size_t end,
+                     ProteinAligner* aligner, bool* passes);
+
+  // threshold outcome against clusters_ [start, end), all blocks of it
+  void TilePasses(const MergeRow& row, size_t start, size_t end,
+                  ProteinAligner* aligner, std::vector<bool>* passes);
+
+  // merge the row's cluster with clusters_ [start, end) that pass, with the
+  // outcomes of TilePasses or computed block by block if tile_passes is
+  // nullptr. true if a full merge ended the row. clusters of `this` are
+  // locked before modifying, because other threads may be accessing them
+  bool MergeTilePassing(const MergeRow& row, size_t start, size_t end,
+                        const std::vector<bool>* tile_passes,
+                        ProteinAligner* aligner);
+
   std::vector<Cluster> clusters_;
 };
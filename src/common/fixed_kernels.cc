@@ -0,0 +1,197 @@
+#include "fixed_kernels.h"
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <immintrin.h>
+
+const int8_t Blosum62::kMatrix[MATRIX_DIM * MATRIX_DIM] = {
+   4,  0,  0, -2, -1, -2,  0, -2, -1,  0, -1, -1, -1,  // A
+  -2,  0, -1, -1, -1,  1,  0,  0,  0, -3,  0, -2,  0,
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // B
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+   0,  0,  9, -3, -4, -2, -3, -3, -1,  0, -3, -1, -1,  // C
+  -3,  0, -3, -3, -3, -1, -1,  0, -1, -2,  0, -2,  0,
+  -2,  0, -3,  6,  2, -3, -1, -1, -3,  0, -1, -4, -3,  // D
+   1,  0, -1,  0, -2,  0, -1,  0, -3, -4,  0, -3,  0,
+  -1,  0, -4,  2,  5, -3, -2,  0, -3,  0,  1, -3, -2,  // E
+   0,  0, -1,  2,  0,  0, -1,  0, -2, -3,  0, -2,  0,
+  -2,  0, -2, -3, -3,  6, -3, -1,  0,  0, -3,  0,  0,  // F
+  -3,  0, -4, -3, -3, -2, -2,  0, -1,  1,  0,  3,  0,
+   0,  0, -3, -1, -2, -3,  6, -2, -4,  0, -2, -4, -3,  // G
+   0,  0, -2, -2, -2,  0, -2,  0, -3, -2,  0, -3,  0,
+  -2,  0, -3, -1,  0, -1, -2,  8, -3,  0, -1, -3, -2,  // H
+   1,  0, -2,  0,  0, -1, -2,  0, -3, -2,  0,  2,  0,
+  -1,  0, -1, -3, -3,  0, -4, -3,  4,  0, -3,  2,  1,  // I
+  -3,  0, -3, -3, -3, -2, -1,  0,  3, -3,  0, -1,  0,
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // J
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+  -1,  0, -3, -1,  1, -3, -2, -1, -3,  0,  5, -2, -1,  // K
+   0,  0, -1,  1,  2,  0, -1,  0, -2, -3,  0, -2,  0,
+  -1,  0, -1, -4, -3,  0, -4, -3,  2,  0, -2,  4,  2,  // L
+  -3,  0, -3, -2, -2, -2, -1,  0,  1, -2,  0, -1,  0,
+  -1,  0, -1, -3, -2,  0, -3, -2,  1,  0, -1,  2,  5,  // M
+  -2,  0, -2,  0, -1, -1, -1,  0,  1, -1,  0, -1,  0,
+  -2,  0, -3,  1,  0, -3,  0,  1, -3,  0,  0, -3, -2,  // N
+   6,  0, -2,  0,  0,  1,  0,  0, -3, -4,  0, -2,  0,
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // O
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+  -1,  0, -3, -1, -1, -4, -2, -2, -3,  0, -1, -3, -2,  // P
+  -2,  0,  7, -1, -2, -1, -1,  0, -2, -4,  0, -3,  0,
+  -1,  0, -3,  0,  2, -3, -2,  0, -3,  0,  1, -2,  0,  // Q
+   0,  0, -1,  5,  1,  0, -1,  0, -2, -2,  0, -1,  0,
+  -1,  0, -3, -2,  0, -3, -2,  0, -3,  0,  2, -2, -1,  // R
+   0,  0, -2,  1,  5, -1, -1,  0, -3, -3,  0, -2,  0,
+   1,  0, -1,  0,  0, -2,  0, -1, -2,  0,  0, -2, -1,  // S
+   1,  0, -1,  0, -1,  4,  1,  0, -2, -3,  0, -2,  0,
+   0,  0, -1, -1, -1, -2, -2, -2, -1,  0, -1, -1, -1,  // T
+   0,  0, -1, -1, -1,  1,  5,  0,  0, -2,  0, -2,  0,
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // U
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+   0,  0, -1, -3, -2, -1, -3, -3,  3,  0, -2,  1,  1,  // V
+  -3,  0, -2, -2, -3, -2,  0,  0,  4, -3,  0, -1,  0,
+  -3,  0, -2, -4, -3,  1, -2, -2, -3,  0, -3, -2, -1,  // W
+  -4,  0, -4, -2, -3, -3, -2,  0, -3, 11,  0,  2,  0,
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // X
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+  -2,  0, -2, -3, -2,  3, -3,  2, -1,  0, -2, -1, -1,  // Y
+  -2,  0, -3, -1, -2, -2, -2,  0, -1,  2,  0,  7,  0,
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // Z
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+};
+
+bool Blosum62::Matches(const double* matrix, double gap_open,
+                       double gap_ext) {
+  if (gap_open != kGapOpen || gap_ext != kGapExt) {
+    return false;
+  }
+  for (int i = 0; i < MATRIX_DIM * MATRIX_DIM; i++) {
+    if (matrix[i] != kMatrix[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// AVX2, 8 lanes
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+namespace fixed_avx2 {
+
+struct Isa {
+  typedef int32_t Score;
+  typedef __m256i Vec;
+  static const int kLanes = 8;
+  // far enough from INT32_MIN that adding gaps can't wrap
+  static Score MinusInf() { return INT32_MIN / 2; }
+  static inline Vec Load(const int32_t* p) {
+    return _mm256_load_si256((const __m256i*)p);
+  }
+  static inline void Store(int32_t* p, Vec v) {
+    _mm256_store_si256((__m256i*)p, v);
+  }
+  static inline Vec Set1(int32_t x) { return _mm256_set1_epi32(x); }
+  static inline Vec Add(Vec a, Vec b) { return _mm256_add_epi32(a, b); }
+  static inline Vec Max(Vec a, Vec b) { return _mm256_max_epi32(a, b); }
+  static inline Vec Shift(Vec v, Vec f) {
+    return _mm256_blend_epi32(
+        _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 0, 1, 2, 3, 4, 5, 6)),
+        f, 1);
+  }
+  static inline bool AnyGe(Vec a, Vec b) {
+    return _mm256_movemask_epi8(_mm256_cmpgt_epi32(b, a)) != -1;
+  }
+  static inline Vec SelGt(Vec a, Vec b, Vec x, Vec y) {
+    return _mm256_blendv_epi8(y, x, _mm256_cmpgt_epi32(a, b));
+  }
+};
+
+#include "local_origin.inc"
+
+template int32_t AlignLocalOrigin<Blosum62>(const Blosum62&, int32_t*, int,
+                                            const char*, int, const char*,
+                                            int, double, int*, int*, int*,
+                                            int*);
+
+}  // namespace fixed_avx2
+
+#pragma GCC pop_options
+
+// AVX-512F, 16 lanes
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+
+namespace fixed_avx512 {
+
+struct Isa {
+  typedef int32_t Score;
+  typedef __m512i Vec;
+  static const int kLanes = 16;
+  static Score MinusInf() { return INT32_MIN / 2; }
+  static inline Vec Load(const int32_t* p) { return _mm512_load_si512(p); }
+  static inline void Store(int32_t* p, Vec v) { _mm512_store_si512(p, v); }
+  static inline Vec Set1(int32_t x) { return _mm512_set1_epi32(x); }
+  static inline Vec Add(Vec a, Vec b) { return _mm512_add_epi32(a, b); }
+  // the zero masked form, _mm512_max_epi32 trips -Wmaybe-uninitialized
+  static inline Vec Max(Vec a, Vec b) {
+    return _mm512_maskz_max_epi32(0xFFFF, a, b);
+  }
+  static inline Vec Shift(Vec v, Vec f) {
+    return _mm512_mask_permutexvar_epi32(
+        f, 0xFFFE,
+        _mm512_setr_epi32(0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14),
+        v);
+  }
+  static inline bool AnyGe(Vec a, Vec b) {
+    return _mm512_cmpge_epi32_mask(a, b) != 0;
+  }
+  static inline Vec SelGt(Vec a, Vec b, Vec x, Vec y) {
+    return _mm512_mask_blend_epi32(_mm512_cmpgt_epi32_mask(a, b), y, x);
+  }
+};
+
+#include "local_origin.inc"
+
+template int32_t AlignLocalOrigin<Blosum62>(const Blosum62&, int32_t*, int,
+                                            const char*, int, const char*,
+                                            int, double, int*, int*, int*,
+                                            int*);
+
+}  // namespace fixed_avx512
+
+#pragma GCC pop_options
+
+template <class Scoring>
+bool AlignLocalFixed(FixedKernelScratch* scratch, bool avx512, const char* s1,
+                     int ls1, const char* s2, int ls2, double threshold,
+                     double* score, int* max1, int* max2, int* min1,
+                     int* min2) {
+  const int lanes = avx512 ? fixed_avx512::Isa::kLanes
+                           : fixed_avx2::Isa::kLanes;
+  const int seg_len = (ls1 + lanes - 1) / lanes;
+  const int64_t rows = (int64_t)seg_len * lanes;
+  // start positions are column * rows + row
+  if ((int64_t)ls2 * rows + rows >= INT32_MAX) {
+    return false;
+  }
+
+  // 64 bytes of slack to align the start
+  scratch->mem.resize((MATRIX_DIM + 6) * rows + 16);
+  int32_t* mem = reinterpret_cast<int32_t*>(
+      (reinterpret_cast<size_t>(scratch->mem.data()) + 63) & ~(size_t)63);
+  if (avx512) {
+    *score = fixed_avx512::AlignLocalOrigin(Scoring(), mem, seg_len, s1,
+                                            ls1, s2, ls2, threshold, max1,
+                                            max2, min1, min2);
+  } else {
+    *score = fixed_avx2::AlignLocalOrigin(Scoring(), mem, seg_len, s1, ls1,
+                                          s2, ls2, threshold, max1, max2,
+                                          min1, min2);
+  }
+  return true;
+}
+
+template bool AlignLocalFixed<Blosum62>(FixedKernelScratch*, bool,
+                                        const char*, int, const char*, int,
+                                        double, double*, int*, int*, int*,
+                                        int*);
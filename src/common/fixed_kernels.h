@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+extern "C" {
+#include "swps3/swps3.h"
+}
+
+// Local alignment kernels specialized at compile time for one scoring
+// scheme: the profile is built from a constexpr table and the gap costs
+// are immediates. Only schemes whose scores are integers are baked in, so
+// the kernels can run in int32 with twice the lanes of the double ones
+// and still give the same results. Everything else takes the generic
+// AlignDouble path.
+
+// BLOSUM62 with the gap costs of data/matrices/json/BLOSUM62.json, as
+// AlignmentEnvironments::UseBlosum loads it (0 for B, J, O, U, X, Z)
+struct Blosum62 {
+  static constexpr int kGapOpen = -12;
+  static constexpr int kGapExt = -1;
+  static const int8_t kMatrix[MATRIX_DIM * MATRIX_DIM];
+
+  static int32_t Score(int a, int b) { return kMatrix[a * MATRIX_DIM + b]; }
+  static int32_t GapOpen() { return kGapOpen; }
+  static int32_t GapExt() { return kGapExt; }
+
+  // true if matrix and the gaps are exactly these
+  static bool Matches(const double* matrix, double gap_open, double gap_ext);
+};
+
+// kernel scratch, grown as needed and kept between calls
+struct FixedKernelScratch {
+  std::vector<int32_t> mem;
+};
+
+// local alignment of s1 and s2 under Scoring, with the same score, max and
+// (1 based) start positions as align_double_local_origin_avx2/avx512,
+// stopping once the score exceeds threshold. 16 lanes with avx512, else 8,
+// the CPU must support AVX2 at least. false if the pair is too large for
+// int32 start positions, the caller then has to use the generic kernels
+template <class Scoring>
+bool AlignLocalFixed(FixedKernelScratch* scratch, bool avx512, const char* s1,
+                     int ls1, const char* s2, int ls2, double threshold,
+                     double* score, int* max1, int* max2, int* min1,
+                     int* min2);
@@ -0,0 +1,136 @@
+#include "float_kernels.h"
+#include <algorithm>
+#include <cfloat>
+#include <cstddef>
+#include <cstdint>
+#include <immintrin.h>
+
+namespace {
+
+// scores of an env, rounded to float
+struct FloatScoring {
+  const double* matrix;
+  float gap_open;
+  float gap_ext;
+
+  float Score(int a, int b) const { return matrix[a * MATRIX_DIM + b]; }
+  float GapOpen() const { return gap_open; }
+  float GapExt() const { return gap_ext; }
+};
+
+}  // namespace
+
+// AVX2, 8 lanes
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+namespace float_avx2 {
+
+struct Isa {
+  typedef float Score;
+  typedef __m256 Vec;
+  static const int kLanes = 8;
+  static Score MinusInf() { return -FLT_MAX; }
+  static inline Vec Load(const float* p) { return _mm256_load_ps(p); }
+  static inline void Store(float* p, Vec v) { _mm256_store_ps(p, v); }
+  static inline Vec Set1(float x) { return _mm256_set1_ps(x); }
+  static inline Vec Add(Vec a, Vec b) { return _mm256_add_ps(a, b); }
+  static inline Vec Max(Vec a, Vec b) { return _mm256_max_ps(a, b); }
+  static inline Vec Shift(Vec v, Vec f) {
+    return _mm256_blend_ps(
+        _mm256_permutevar8x32_ps(v, _mm256_setr_epi32(0, 0, 1, 2, 3, 4, 5, 6)),
+        f, 1);
+  }
+  static inline bool AnyGe(Vec a, Vec b) {
+    return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_GE_OQ)) != 0;
+  }
+  static inline Vec SelGt(Vec a, Vec b, Vec x, Vec y) {
+    return _mm256_blendv_ps(y, x, _mm256_cmp_ps(a, b, _CMP_GT_OQ));
+  }
+};
+
+#include "local_origin.inc"
+
+template float AlignLocalOrigin<FloatScoring>(const FloatScoring&, float*,
+                                              int, const char*, int,
+                                              const char*, int, double, int*,
+                                              int*, int*, int*);
+
+}  // namespace float_avx2
+
+#pragma GCC pop_options
+
+// AVX-512F, 16 lanes
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+
+namespace float_avx512 {
+
+struct Isa {
+  typedef float Score;
+  typedef __m512 Vec;
+  static const int kLanes = 16;
+  static Score MinusInf() { return -FLT_MAX; }
+  static inline Vec Load(const float* p) { return _mm512_load_ps(p); }
+  static inline void Store(float* p, Vec v) { _mm512_store_ps(p, v); }
+  static inline Vec Set1(float x) { return _mm512_set1_ps(x); }
+  static inline Vec Add(Vec a, Vec b) { return _mm512_add_ps(a, b); }
+  // the zero masked form, _mm512_max_ps trips -Wmaybe-uninitialized
+  static inline Vec Max(Vec a, Vec b) {
+    return _mm512_maskz_max_ps(0xFFFF, a, b);
+  }
+  static inline Vec Shift(Vec v, Vec f) {
+    return _mm512_mask_permutexvar_ps(
+        f, 0xFFFE,
+        _mm512_setr_epi32(0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14),
+        v);
+  }
+  static inline bool AnyGe(Vec a, Vec b) {
+    return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ) != 0;
+  }
+  static inline Vec SelGt(Vec a, Vec b, Vec x, Vec y) {
+    return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(a, b, _CMP_GT_OQ), y, x);
+  }
+};
+
+#include "local_origin.inc"
+
+template float AlignLocalOrigin<FloatScoring>(const FloatScoring&, float*,
+                                              int, const char*, int,
+                                              const char*, int, double, int*,
+                                              int*, int*, int*);
+
+}  // namespace float_avx512
+
+#pragma GCC pop_options
+
+bool AlignLocalFloat(FloatKernelScratch* scratch, bool avx512,
+                     const AlignmentEnvironment& env, const char* s1, int ls1,
+                     const char* s2, int ls2, double* score, int* max1,
+                     int* max2, int* min1, int* min2) {
+  const int lanes = avx512 ? float_avx512::Isa::kLanes
+                           : float_avx2::Isa::kLanes;
+  const int seg_len = (ls1 + lanes - 1) / lanes;
+  const int64_t rows = (int64_t)seg_len * lanes;
+  // start positions are column * rows + row, exact in float up to 2^24
+  if ((int64_t)ls2 * rows + rows >= (int64_t(1) << 24)) {
+    return false;
+  }
+
+  FloatScoring scoring = {env.matrix, float(env.gap_open),
+                          float(env.gap_extend)};
+  // 64 bytes of slack to align the start
+  scratch->mem.resize((MATRIX_DIM + 6) * rows + 16);
+  float* mem = reinterpret_cast<float*>(
+      (reinterpret_cast<size_t>(scratch->mem.data()) + 63) & ~(size_t)63);
+  if (avx512) {
+    *score = float_avx512::AlignLocalOrigin(scoring, mem, seg_len, s1, ls1,
+                                            s2, ls2, DBL_MAX, max1, max2,
+                                            min1, min2);
+  } else {
+    *score = float_avx2::AlignLocalOrigin(scoring, mem, seg_len, s1, ls1, s2,
+                                          ls2, DBL_MAX, max1, max2, min1,
+                                          min2);
+  }
+  return true;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <vector>
+#include "alignment_environment.h"
+
+// float32 local alignment with start tracking, twice the lanes of the
+// double kernels. scores carry float rounding, so these are only used
+// where an approximate score and region will do, like picking the
+// starting point of AlignLocal (Parameters::float_start_point)
+
+// kernel scratch, grown as needed and kept between calls
+struct FloatKernelScratch {
+  std::vector<float> mem;
+};
+
+// local alignment of s1 and s2 under env, the float counterpart of
+// align_double_local_origin_avx2/avx512 without a threshold. 16 lanes with
+// avx512, else 8, the CPU must support AVX2 at least. false if the pair is
+// too large for exact float start positions (about 2^24 cells), the caller
+// then has to use the double kernels
+bool AlignLocalFloat(FloatKernelScratch* scratch, bool avx512,
+                     const AlignmentEnvironment& env, const char* s1, int ls1,
+                     const char* s2, int ls2, double* score, int* max1,
+                     int* max2, int* min1, int* min2);
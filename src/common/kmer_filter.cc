@@ -0,0 +1,130 @@
+#include "kmer_filter.h"
+#include <algorithm>
+#include <cassert>
+
+using namespace std;
+
+namespace {
+
+// reduced alphabet group of each residue 'A' + i, -1 ends a k-mer.
+// B and Z go with D/N and E/Q, U with C
+const int8_t kReduced[26] = {
+    2,  // A
+    7,  // B
+    1,  // C
+    7,  // D
+    7,  // E
+    6,  // F
+    3,  // G
+    9,  // H
+    0,  // I
+    -1, // J
+    8,  // K
+    0,  // L
+    0,  // M
+    7,  // N
+    -1, // O
+    5,  // P
+    7,  // Q
+    8,  // R
+    4,  // S
+    4,  // T
+    1,  // U
+    0,  // V
+    6,  // W
+    -1, // X
+    6,  // Y
+    7   // Z
+};
+
+const uint32_t kAlphabetSize = 10;
+
+}  // namespace
+
+vector<uint64_t> KmerFilter::Kmers(const char* seq, int seq_len, int k) {
+  assert(k > 0 && k <= kMaxKmerSize);
+  uint32_t modulus = 1;
+  for (int i = 0; i < k; i++) {
+    modulus *= kAlphabetSize;
+  }
+
+  vector<uint64_t> kmers;
+  kmers.reserve(max(seq_len - k + 1, 0));
+  uint32_t code = 0;
+  int run = 0;  // residues in the alphabet ending at i
+  for (int i = 0; i < seq_len; i++) {
+    int c = seq[i];
+    int g = c >= 0 && c < 26 ? kReduced[c] : -1;
+    if (g < 0) {
+      run = 0;
+      code = 0;
+      continue;
+    }
+    code = (code * kAlphabetSize + g) % modulus;
+    if (++run >= k) {
+      kmers.push_back(uint64_t(code) << 32 | uint32_t(i - k + 1));
+    }
+  }
+  sort(kmers.begin(), kmers.end());
+  return kmers;
+}
+
+void KmerFilter::SetKmers(int kmer_size, Sequence* seq) {
+  if (kmer_size > 0) {
+    seq->SetKmers(Kmers(seq->Seq().data(), seq->Seq().size(), kmer_size));
+  }
+}
+
+bool KmerFilter::SharesDiagonal(const Sequence& seq1, const Sequence& seq2,
+                                int min_hits) {
+  const auto& kmers1 = seq1.Kmers();
+  const auto& kmers2 = seq2.Kmers();
+  int seq2_len = seq2.Seq().size();
+  size_t num_diags = seq1.Seq().size() + seq2_len + 1;
+  if (diag_hits_.size() < num_diags) {
+    diag_hits_.resize(num_diags, 0);
+  }
+
+  // merge the two sorted lists, every pair of positions of a shared k-mer
+  // is a hit on their diagonal
+  bool found = false;
+  size_t i = 0, j = 0;
+  while (!found && i < kmers1.size() && j < kmers2.size()) {
+    uint32_t code1 = kmers1[i] >> 32;
+    uint32_t code2 = kmers2[j] >> 32;
+    if (code1 < code2) {
+      i++;
+    } else if (code2 < code1) {
+      j++;
+    } else {
+      size_t i_end = i, j_end = j;
+      while (i_end < kmers1.size() && (kmers1[i_end] >> 32) == code1) {
+        i_end++;
+      }
+      while (j_end < kmers2.size() && (kmers2[j_end] >> 32) == code1) {
+        j_end++;
+      }
+      for (size_t a = i; a < i_end && !found; a++) {
+        for (size_t b = j; b < j_end; b++) {
+          int diag = int(uint32_t(kmers1[a])) - int(uint32_t(kmers2[b])) +
+                     seq2_len;
+          if (diag_hits_[diag]++ == 0) {
+            touched_.push_back(diag);
+          }
+          if (int(diag_hits_[diag]) >= min_hits) {
+            found = true;
+            break;
+          }
+        }
+      }
+      i = i_end;
+      j = j_end;
+    }
+  }
+
+  for (int diag : touched_) {
+    diag_hits_[diag] = 0;
+  }
+  touched_.clear();
+  return found;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "sequence.h"
+
+// cheap prefilter ahead of the int16 threshold kernel. residues are mapped
+// to a 10 letter reduced alphabet (LVIM C A G ST P FYW EDNQ KR H) and a
+// pair is only aligned if some diagonal of the two sequences holds at
+// least min_hits of their shared k-mers. enabled with
+// Parameters::kmer_size, larger kmer_size and kmer_min_hits reject more
+// pairs and lose more distant homologs
+class KmerFilter {
+ public:
+  static const int kMaxKmerSize = 9;
+
+  // reduced alphabet k-mers of seq, sorted, each the k-mer code in the
+  // upper 32 bits and its position in seq in the lower. k-mers over a
+  // residue outside the alphabet (X, ...) are left out
+  static std::vector<uint64_t> Kmers(const char* seq, int seq_len, int k);
+
+  // stores Kmers() of seq in seq, nothing if kmer_size is 0
+  static void SetKmers(int kmer_size, Sequence* seq);
+
+  // true if one diagonal of seq1 and seq2 has min_hits shared k-mers
+  bool SharesDiagonal(const Sequence& seq1, const Sequence& seq2,
+                      int min_hits);
+
+ private:
+  // shared k-mers per diagonal i - j + seq2_len of the current pair, and
+  // the diagonals to clear again
+  std::vector<uint32_t> diag_hits_;
+  std::vector<int> touched_;
+};
@@ -1,70 +1,106 @@
 #include "merge_executor.h"
+#include <algorithm>
 
 using std::cout;
-using namespace std::literals::chrono_literals;
 
-MergeExecutor::MergeExecutor(size_t num_threads, size_t capacity,
-                             AlignmentEnvironments* envs, Parameters* params)
-    : envs_(envs), params_(params), num_threads_(num_threads) {
-  work_queue_.reset(new ConcurrentQueue<WorkItem>(capacity));
-
-  num_active_threads_ = num_threads;
-  threads_.reserve(num_threads_);
-  for (size_t i = 0; i < num_threads_; i++) {
-    threads_.push_back(std::thread(&MergeExecutor::Worker, this));
-  }
-  //cout << "merge executor started threads\n";
-}
+MergeExecutor::MergeExecutor(TaskScheduler* scheduler, size_t capacity,
+                             AlignmentEnvironments* envs, Parameters* params,
+                             PairCache* pair_cache)
+    : scheduler_(scheduler),
+      capacity_(capacity),
+      envs_(envs),
+      params_(params),
+      pair_cache_(pair_cache),
+      aligners_(scheduler->NumThreads()),
+      prefetch_aligners_(scheduler->NumThreads()) {}
 
 MergeExecutor::~MergeExecutor() {
-  //cout << "MergeExecutor waiting for work queue to empty\n";
-  while (!work_queue_->empty()) {
-    std::this_thread::sleep_for(1s);
-    //cout << "MergeExecutor work queue has " << work_queue_->size() << " entries left\n";
+  uint64_t num_alignments = 0, num_bound_skipped = 0, num_kmer_skipped = 0,
+           num_composition_skipped = 0, num_ungapped_accepted = 0,
+           num_ungapped_rejected = 0;
+  for (auto& aligner : aligners_) {
+    if (!aligner) {
+      continue;
+    }
+    num_alignments += aligner->NumAlignments();
+    num_bound_skipped += aligner->NumBoundSkipped();
+    num_kmer_skipped += aligner->NumKmerSkipped();
+    num_composition_skipped += aligner->NumCompositionSkipped();
+    num_ungapped_accepted += aligner->NumUngappedAccepted();
+    num_ungapped_rejected += aligner->NumUngappedRejected();
   }
-  //cout << "MergeExecutor Queue emptied, unblocking...\n";
-  run_ = false;
-  work_queue_->unblock();
-  for (auto& f : threads_) {
-    f.join();
+  cout << "Num pass threshold alignments: " << num_alignments << "\n";
+  cout << "Num pairs skipped by score bound: " << num_bound_skipped << "\n";
+  cout << "Num pairs skipped by composition: " << num_composition_skipped
+       << "\n";
+  cout << "Num pairs skipped by k-mer filter: " << num_kmer_skipped << "\n";
+  cout << "Num threshold alignments accepted ungapped: "
+       << num_ungapped_accepted << "\n";
+  cout << "Num threshold alignments rejected ungapped: "
+       << num_ungapped_rejected << "\n";
+
+  uint64_t num_prefetched = 0;
+  for (auto& aligner : prefetch_aligners_) {
+    if (aligner) {
+      num_prefetched += aligner->NumAlignments();
+    }
+  }
+  if (num_prefetched > 0) {
+    cout << "Num thresholds computed ahead of their merge: "
+         << num_prefetched << "\n";
   }
-  //cout << "All threads finished.\n";
-  cout << "Num pass threshold alignments: " << num_alignments_ << "\n";
 }
 
-void MergeExecutor::EnqueueMerge(const WorkItem& item) {
-  if (!work_queue_->push(std::move(item))) {
-    cout << "failed to push work item to queue.\n";
+ProteinAligner* MergeExecutor::SlotAligner(
+    std::vector<std::unique_ptr<ProteinAligner>>* aligners) {
+  // a slot runs one tile at a time, tiles never wait
+  auto& aligner = (*aligners)[scheduler_->Slot()];
+  if (!aligner) {
+    aligner.reset(new ProteinAligner(envs_, params_, pair_cache_));
   }
+  return aligner.get();
 }
 
-void MergeExecutor::Worker() {
-  //int my_id = id_.fetch_add(1, std::memory_order_relaxed);
-
-  //std::cout << absl::StrCat("merger thread spinning up with id ",
-                   //my_id, "\n");
-
-  ProteinAligner aligner(envs_, params_);
-
-  while (run_.load()) {
-    // read from queue, and align work item
-    WorkItem item;
-    if (!work_queue_->pop(item)) {
-      continue;
-    }
-
-    auto* cluster = std::get<0>(item);
-    auto* cluster_set = std::get<1>(item);
-    auto* notification = std::get<2>(item);
-
-    //cout << "merge thread merging ...\n";
-
-    cluster_set->MergeClusterLocked(cluster, &aligner);
-
-    notification->Notify();
+void MergeExecutor::EnqueueMerge(TaskScheduler::TaskGroup* group,
+                                 const WorkItem& item) {
+  scheduler_->Submit(group, [this, item]() {
+    auto* row = std::get<0>(item);
+    row->other->MergeTile(row, std::get<1>(item), SlotAligner(&aligners_));
+  });
+}
 
+void MergeExecutor::EnqueuePrefetch(
+    TaskScheduler::TaskGroup* group,
+    std::shared_ptr<const std::vector<const Sequence*>> queries,
+    std::shared_ptr<const std::vector<const Sequence*>> targets,
+    const std::atomic<bool>* cancelled) {
+  const size_t num_tasks = std::min(
+      queries->size(), scheduler_->NumThreads() * kPrefetchTasksPerThread);
+  for (size_t task = 0; task < num_tasks; task++) {
+    const size_t start = queries->size() * task / num_tasks;
+    const size_t end = queries->size() * (task + 1) / num_tasks;
+    scheduler_->Submit(group, [this, queries, targets, start, end,
+                               cancelled]() {
+      auto* aligner = SlotAligner(&prefetch_aligners_);
+      const size_t width = std::min<size_t>(Profile::BatchWidth(),
+                                            ProteinAligner::kMaxBatch);
+      const Sequence* batch[ProteinAligner::kMaxBatch];
+      for (size_t q = start; q < end && !cancelled->load(); q++) {
+        const auto* query = (*queries)[q];
+        const auto& profile = aligner->Profiles().Get(
+            query->ID(), query->Seq().data(), query->Seq().size());
+        size_t n = 0;
+        for (size_t i = 0; i < targets->size() && !cancelled->load(); i++) {
+          if (aligner->MayPassThreshold(*query, *(*targets)[i])) {
+            batch[n++] = (*targets)[i];
+          }
+          if (n == width || (n > 0 && i + 1 == targets->size())) {
+            aligner->PassesThresholdBatch(profile, *query, batch, n);
+            n = 0;
+          }
+        }
+        aligner->Profiles().Clear();
+      }
+    });
   }
-
-  num_alignments_ += aligner.NumAlignments();
-
 }
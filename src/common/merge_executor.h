@@ -1,41 +1,69 @@
-
 #pragma once
 
 #include <atomic>
+#include <memory>
 #include <utility>
-#include "absl/synchronization/mutex.h"
-#include "absl/synchronization/notification.h"
+#include <vector>
 #include "alignment_environment.h"
-#include "multi_notification.h"
 #include "cluster_set.h"
 #include "params.h"
+#include "task_scheduler.h"
 
+// runs merge tiles as tasks of the run's TaskScheduler, with an aligner per
+// scheduler slot
 class MergeExecutor {
  public:
-  typedef std::tuple<Cluster*, ClusterSet*, MultiNotification*> WorkItem;
+  typedef std::tuple<ClusterSet::MergeRow*, size_t> WorkItem;
 
   MergeExecutor() = delete;
   ~MergeExecutor();
 
-  MergeExecutor(size_t num_threads, size_t capacity,
-                AlignmentEnvironments* envs, Parameters* params);
+  // capacity is the tiles one set merge may have queued
+  MergeExecutor(TaskScheduler* scheduler, size_t capacity,
+                AlignmentEnvironments* envs, Parameters* params,
+                PairCache* pair_cache = nullptr);
 
-  void EnqueueMerge(const WorkItem& item);
+  // group of the tiles of one set merge, tiles never wait
+  TaskScheduler::TaskGroup NewGroup() const {
+    return TaskScheduler::TaskGroup(capacity_,
+                                    TaskScheduler::TaskGroup::Kind::kLeaf);
+  }
 
-  void Initialize();
+  // runs tiles of group while it is full
+  void EnqueueMerge(TaskScheduler::TaskGroup* group, const WorkItem& item);
 
- private:
-  std::unique_ptr<ConcurrentQueue<WorkItem>> work_queue_;
+  // runs tiles of group until all of them are done
+  void Wait(TaskScheduler::TaskGroup* group) { scheduler_->Wait(group); }
+
+  // true if thresholds computed ahead of a merge are kept for it, in the
+  // pair cache, and there are pool threads to compute them
+  bool CanPrefetch() const {
+    return pair_cache_ && scheduler_->NumThreads() > 1;
+  }
 
-  std::vector<std::thread> threads_;
+  // thresholds of the queries against the targets, into the pair cache,
+  // for a merge that cannot start yet. stops once cancelled is set. group
+  // should be a background group so the merges running now come first
+  void EnqueuePrefetch(
+      TaskScheduler::TaskGroup* group,
+      std::shared_ptr<const std::vector<const Sequence*>> queries,
+      std::shared_ptr<const std::vector<const Sequence*>> targets,
+      const std::atomic<bool>* cancelled);
+
+ private:
+  // aligner of the calling scheduler slot, built on first use. prefetches
+  // have their own so the merge stats only count merge alignments
+  ProteinAligner* SlotAligner(
+      std::vector<std::unique_ptr<ProteinAligner>>* aligners);
 
-  std::atomic_uint_fast32_t num_active_threads_, id_{0};
-  std::atomic<bool> run_{true};
+  TaskScheduler* scheduler_;
+  size_t capacity_;
   AlignmentEnvironments* envs_;
   Parameters* params_;
-  size_t num_threads_;
-  std::atomic_uint_fast32_t num_alignments_{0};
+  PairCache* pair_cache_;
+  std::vector<std::unique_ptr<ProteinAligner>> aligners_;
+  std::vector<std::unique_ptr<ProteinAligner>> prefetch_aligners_;
 
-  // thread worker func
-  void Worker();
+  // prefetch tasks per thread, each a range of the queries
+  static const size_t kPrefetchTasksPerThread = 4;
 };
@@ -0,0 +1,88 @@
+#include "pair_cache.h"
+#include <algorithm>
+
+PairCache::PairCache(size_t budget_mb) {
+  size_t budget_bytes = budget_mb * 1024 * 1024;
+  InitTable(budget_bytes / 2, &thresholds_);
+  InitTable(budget_bytes / 2, &alignments_);
+}
+
+template <typename V>
+void PairCache::InitTable(size_t budget_bytes, Table<V>* table) {
+  // the slot, and the index entry with its control byte at the lowest
+  // load factor the index grows to
+  size_t entry_bytes = sizeof(typename Shard<V>::Slot) +
+                       2 * (sizeof(Key) + sizeof(uint32_t) + 1);
+  table->shards.reset(new Shard<V>[kNumShards]);
+  table->shard_capacity =
+      std::max(size_t(1), budget_bytes / kNumShards / entry_bytes);
+}
+
+template <typename V>
+bool PairCache::Find(Table<V>* table, const Key& key, V* value) {
+  auto& shard = table->shards[absl::Hash<Key>()(key) % kNumShards];
+  {
+    absl::MutexLock l(&shard.mu);
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+      auto& slot = shard.slots[it->second];
+      slot.referenced = true;
+      *value = slot.value;
+      num_hits_.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+  num_misses_.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+template <typename V>
+void PairCache::Insert(Table<V>* table, const Key& key, const V& value) {
+  auto& shard = table->shards[absl::Hash<Key>()(key) % kNumShards];
+  absl::MutexLock l(&shard.mu);
+  auto it = shard.index.find(key);
+  if (it != shard.index.end()) {
+    // another thread got there first, both computed the same thing
+    return;
+  }
+  if (shard.slots.size() < table->shard_capacity) {
+    shard.index[key] = shard.slots.size();
+    shard.slots.push_back({key, value, false});
+    return;
+  }
+  // advance the hand past referenced slots, clearing them, and replace
+  // the first unreferenced one
+  while (shard.slots[shard.hand].referenced) {
+    shard.slots[shard.hand].referenced = false;
+    shard.hand = (shard.hand + 1) % shard.slots.size();
+  }
+  auto& victim = shard.slots[shard.hand];
+  shard.index.erase(victim.key);
+  shard.index[key] = shard.hand;
+  victim = {key, value, false};
+  shard.hand = (shard.hand + 1) % shard.slots.size();
+  num_evictions_.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool PairCache::FindThreshold(Kind kind, uint32_t seq1, uint32_t seq2,
+                              bool* passes) {
+  return Find(&thresholds_,
+              MakeKey(kind, std::min(seq1, seq2), std::max(seq1, seq2)),
+              passes);
+}
+
+void PairCache::InsertThreshold(Kind kind, uint32_t seq1, uint32_t seq2,
+                                bool passes) {
+  Insert(&thresholds_,
+         MakeKey(kind, std::min(seq1, seq2), std::max(seq1, seq2)), passes);
+}
+
+bool PairCache::FindAlignment(Kind kind, uint32_t seq1, uint32_t seq2,
+                              ProteinAligner::Alignment* alignment) {
+  return Find(&alignments_, MakeKey(kind, seq1, seq2), alignment);
+}
+
+void PairCache::InsertAlignment(Kind kind, uint32_t seq1, uint32_t seq2,
+                                const ProteinAligner::Alignment& alignment) {
+  Insert(&alignments_, MakeKey(kind, seq1, seq2), alignment);
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "aligner.h"
+
+// results of aligned sequence pairs keyed by their absolute ids, shared by
+// all aligner threads of a run so a pair the merges already aligned is not
+// aligned again, e.g. by the all-all phase. memory bounded, once full each
+// shard evicts with the CLOCK policy: entries hit since the hand last
+// passed survive one more round. each result is stored under the env
+// class it was computed in and is only returned for that same class
+class PairCache {
+ public:
+  enum class Kind : uint8_t {
+    kThreshold,        // PassesThreshold*, just score env
+    kLogPamThreshold,  // LogPamPassesThreshold, logpam just score env
+    kAlignSingle,      // AlignSingle, just score env
+    kAlignLocal,       // AlignLocal, best of the pam envs
+  };
+
+  // budget_mb split evenly over the threshold and the alignment entries
+  explicit PairCache(size_t budget_mb);
+
+  // do not copy or move
+  PairCache(const PairCache& other) = delete;
+  PairCache& operator=(const PairCache& other) = delete;
+
+  // threshold scores are symmetric, so (seq1, seq2) and (seq2, seq1) share
+  // an entry. true and the outcome in passes if cached
+  bool FindThreshold(Kind kind, uint32_t seq1, uint32_t seq2, bool* passes);
+  void InsertThreshold(Kind kind, uint32_t seq1, uint32_t seq2, bool passes);
+
+  // alignments are stored for seq1 against seq2 only
+  bool FindAlignment(Kind kind, uint32_t seq1, uint32_t seq2,
+                     ProteinAligner::Alignment* alignment);
+  void InsertAlignment(Kind kind, uint32_t seq1, uint32_t seq2,
+                       const ProteinAligner::Alignment& alignment);
+
+  uint64_t NumHits() const { return num_hits_; }
+  uint64_t NumMisses() const { return num_misses_; }
+  uint64_t NumEvictions() const { return num_evictions_; }
+
+ private:
+  struct Key {
+    uint64_t seqs;  // seq1 << 32 | seq2
+    Kind kind;
+    bool operator==(const Key& other) const {
+      return seqs == other.seqs && kind == other.kind;
+    }
+    template <typename H>
+    friend H AbslHashValue(H h, const Key& key) {
+      return H::combine(std::move(h), key.seqs, key.kind);
+    }
+  };
+
+  // a shard of one table, capacity entries at most
+  template <typename V>
+  struct Shard {
+    struct Slot {
+      Key key;
+      V value;
+      bool referenced;  // hit since the clock hand last passed
+    };
+    absl::Mutex mu;
+    absl::flat_hash_map<Key, uint32_t> index;  // into slots
+    std::vector<Slot> slots;
+    size_t hand = 0;
+  };
+
+  template <typename V>
+  struct Table {
+    std::unique_ptr<Shard<V>[]> shards;
+    size_t shard_capacity = 0;
+  };
+
+  // shards per table, enough that threads rarely meet on one
+  static const size_t kNumShards = 64;
+
+  template <typename V>
+  void InitTable(size_t budget_bytes, Table<V>* table);
+  template <typename V>
+  bool Find(Table<V>* table, const Key& key, V* value);
+  template <typename V>
+  void Insert(Table<V>* table, const Key& key, const V& value);
+
+  static Key MakeKey(Kind kind, uint32_t seq1, uint32_t seq2) {
+    return Key{uint64_t(seq1) << 32 | seq2, kind};
+  }
+
+  Table<bool> thresholds_;
+  Table<ProteinAligner::Alignment> alignments_;
+
+  std::atomic<uint64_t> num_hits_{0};
+  std::atomic<uint64_t> num_misses_{0};
+  std::atomic<uint64_t> num_evictions_{0};
+};
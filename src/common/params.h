@@ -1,6 +1,8 @@
 
 #pragma once
 
+#include <string>
+
 // TODO rename to something less generic e.g AlignerParams
 struct Parameters {
   int min_score = 181;
@@ -10,4 +12,42 @@ struct Parameters {
   // min score for full merge
   float min_full_merge_score = 250.0f;
   bool use_blosum = false;
+  // search pam_list_ coarse to fine for the starting point of AlignLocal
+  // instead of aligning all of it. approximate: it assumes the best env is
+  // the single peak of the envs around the EstimPam estimate, and can pick
+  // another start point than the full search, changing or losing matches
+  bool adaptive_pam_search = false;
+  // diagonals either side of the previous alignment the AlignLocal
+  // refinement alignments are restricted to, 0 to align unbanded
+  int refine_band = 0;
+  // reduced alphabet k-mer length of the KmerFilter ahead of the merge
+  // threshold alignments, 0 to align every pair. 3 with 3 hits lost no
+  // matches on our test sets, larger values start dropping distant pairs
+  int kmer_size = 0;
+  // shared k-mers one diagonal needs for the pair to be aligned
+  int kmer_min_hits = 3;
+  // X-drop (score units) of the ungapped seed-and-extend stage ahead of the
+  // threshold kernels, 0 to skip it. pairs whose ungapped score passes are
+  // accepted without a gapped alignment
+  double ungapped_xdrop = 0;
+  // pairs whose ungapped score is below this fraction of the threshold are
+  // rejected as well, 0 to leave them all to the gapped kernels. 20 and 0.3
+  // lost no matches on our test sets, 0.5 started dropping some
+  double ungapped_reject_fraction = 0;
+  // L1 distance between the amino acid compositions of two sequences (0 to
+  // 2) above which the merges don't align them, 0 to align every pair.
+  // matched pairs on our test sets were within 0.61, 0.8 lost nothing
+  float max_composition_distance = 0;
+  // memory budget (MB) of the PairCache that lets the all-all phase reuse
+  // the threshold results of the merges, 0 to not cache
+  size_t pair_cache_mb = 0;
+  // align the envs of the exhaustive starting point search of AlignLocal
+  // in float, redoing in double only those that come close to the chosen
+  // one. the final alignment is always double. needs AVX2, ignored with
+  // adaptive_pam_search, which would redo most of its few envs anyway
+  bool float_start_point = false;
+  // JSON table of the int16 threshold kernel to use per query and target
+  // length class. loaded if it exists, else the kernels are timed at
+  // startup and the result is written here. empty to time them every run
+  std::string kernel_tuning_file;
 };
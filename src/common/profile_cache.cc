@@ -0,0 +1,608 @@
+#include "profile_cache.h"
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <vector>
+#include "absl/strings/str_cat.h"
+#include "json.hpp"
+extern "C" {
+#include "swps3/DynProgr_avx_byte.h"
+#include "swps3/DynProgr_avx_short.h"
+#include "swps3/DynProgr_batch_short.h"
+#include "swps3/DynProgr_diag_short.h"
+#include "swps3/DynProgr_sse_byte.h"
+#include "swps3/DynProgr_sse_short.h"
+}
+
+namespace {
+
+enum class ShortKernel { SSE2, AVX2, AVX512BW };
+
+ShortKernel DetectShortKernel() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512bw")) {
+    return ShortKernel::AVX512BW;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return ShortKernel::AVX2;
+  }
+  return ShortKernel::SSE2;
+}
+
+// the CPU does not change under us, so check once
+const ShortKernel short_kernel = DetectShortKernel();
+
+double ToEnvUnits(double score, const Options& options) {
+  if (score >= FLT_MAX)
+    return SHRT_MAX;
+  else
+    return score / (65535.0f / options.threshold);
+}
+
+using Kernel = Profile::Kernel;
+
+const int kNumKernels = 5;
+// tuning file names, in Kernel order
+const char* const kKernelNames[kNumKernels] = {
+    "sse2", "avx2", "avx512bw", "diag_avx2", "diag_avx512bw"};
+
+bool Supported(Kernel kernel) {
+  switch (kernel) {
+    case Kernel::Striped32:
+    case Kernel::Diag32:
+      return short_kernel == ShortKernel::AVX512BW;
+    case Kernel::Striped16:
+    case Kernel::Diag16:
+      return short_kernel != ShortKernel::SSE2;
+    default:
+      return true;
+  }
+}
+
+// a length is in the first class whose bound it does not exceed, else in
+// the last one. a striped kernel pads the query to a multiple of its lanes
+// and the anti diagonal one idles lanes on the first and last diagonals, so
+// the fastest kernel changes mostly among short lengths
+const int kNumLengthClasses = 5;
+const int kLengthBounds[kNumLengthClasses - 1] = {24, 48, 96, 192};
+// lengths each class is timed at
+const int kTimedLengths[kNumLengthClasses] = {16, 36, 72, 144, 288};
+// times each kernel of a class is timed, and by how much faster than the
+// widest striped kernel another must be in the median to be picked
+const int kTuningRounds = 5;
+const double kTuningMargin = 0.25;
+// wider striped kernels first, they lose the least when a class holds
+// longer sequences than the timed one
+const Kernel kTuningPreference[kNumKernels] = {
+    Kernel::Striped32, Kernel::Striped16, Kernel::Striped8, Kernel::Diag32,
+    Kernel::Diag16};
+
+int LengthClass(int len) {
+  int c = 0;
+  while (c < kNumLengthClasses - 1 && len > kLengthBounds[c]) c++;
+  return c;
+}
+
+// kernel per query and target length class
+using KernelChoice =
+    std::array<std::array<Kernel, kNumLengthClasses>, kNumLengthClasses>;
+
+KernelChoice WidestStriped() {
+  Kernel kernel = Kernel::Striped8;
+  if (short_kernel == ShortKernel::AVX512BW) {
+    kernel = Kernel::Striped32;
+  } else if (short_kernel == ShortKernel::AVX2) {
+    kernel = Kernel::Striped16;
+  }
+  KernelChoice choice;
+  for (auto& row : choice) row.fill(kernel);
+  return choice;
+}
+
+// set by Profile::TuneKernels before any alignment, read only after
+KernelChoice kernel_choice = WidestStriped();
+
+}  // namespace
+
+int Profile::BatchWidth() {
+  return short_kernel == ShortKernel::AVX512BW ? 32 : 1;
+}
+
+const char* Profile::KernelName() {
+  switch (short_kernel) {
+    case ShortKernel::AVX512BW:
+      return "AVX-512BW (32 x int16)";
+    case ShortKernel::AVX2:
+      return "AVX2 (16 x int16)";
+    default:
+      return "SSE2 (8 x int16)";
+  }
+}
+
+Profile::Profile(const char* seq, int seq_len, const AlignmentEnvironment& env)
+    : env_(&env), seq_(seq), seq_len_(seq_len) {}
+
+Profile::~Profile() {
+  if (batch_) {
+    swps3_freeProfileShortBatch(static_cast<ProfileShortBatch*>(batch_));
+  }
+  if (striped_[0]) {
+    swps3_freeProfileShortSSE(static_cast<ProfileShort*>(striped_[0]));
+  }
+  for (int i = 1; i < 3; i++) {
+    if (striped_[i]) {
+      swps3_freeProfileShortAVX(static_cast<ProfileShortAVX*>(striped_[i]));
+    }
+  }
+  if (diag_) swps3_freeProfileShortDiag(static_cast<ProfileShortDiag*>(diag_));
+  if (short_kernel == ShortKernel::SSE2) {
+    if (byte_) swps3_freeProfileByteSSE(static_cast<ProfileByte*>(byte_));
+  } else {
+    if (byte_) swps3_freeProfileByteAVX(static_cast<ProfileByteAVX*>(byte_));
+  }
+}
+
+double Profile::Score(const char* seq2, int seq2_len) const {
+  return ScoreWith(kernel_choice[LengthClass(seq_len_)][LengthClass(seq2_len)],
+                   seq2, seq2_len);
+}
+
+double Profile::ScoreWith(Kernel kernel, const char* seq2,
+                          int seq2_len) const {
+  Options options;
+  options.gapOpen = env_->gap_open_int16;
+  options.gapExt = env_->gap_ext_int16;
+  options.threshold = env_->threshold;
+
+  if (kernel == Kernel::Diag16 || kernel == Kernel::Diag32) {
+    if (!diag_) {
+      diag_ = swps3_createProfileShortDiag(seq_, seq_len_, env_->matrix_int16);
+    }
+  } else {
+    void*& striped = striped_[int(kernel)];
+    if (!striped) {
+      switch (kernel) {
+        case Kernel::Striped32:
+          striped = swps3_createProfileShortAVX512(seq_, seq_len_,
+                                                   env_->matrix_int16);
+          break;
+        case Kernel::Striped16:
+          striped = swps3_createProfileShortAVX2(seq_, seq_len_,
+                                                 env_->matrix_int16);
+          break;
+        default:
+          striped = swps3_createProfileShortSSE(seq_, seq_len_,
+                                                env_->matrix_int16);
+      }
+    }
+  }
+
+  // all kernels give bit-identical scores, they only differ in speed
+  double score;
+  switch (kernel) {
+    case Kernel::Diag32:
+      score = swps3_alignmentShortDiagAVX512(
+          static_cast<ProfileShortDiag*>(diag_), seq2, seq2_len, &options);
+      break;
+    case Kernel::Diag16:
+      score = swps3_alignmentShortDiagAVX2(
+          static_cast<ProfileShortDiag*>(diag_), seq2, seq2_len, &options);
+      break;
+    case Kernel::Striped32:
+      score = swps3_alignmentShortAVX512(
+          static_cast<ProfileShortAVX*>(striped_[2]), seq2, seq2_len, &options);
+      break;
+    case Kernel::Striped16:
+      score = swps3_alignmentShortAVX2(
+          static_cast<ProfileShortAVX*>(striped_[1]), seq2, seq2_len, &options);
+      break;
+    default:
+      score = swps3_alignmentShortSSE(static_cast<ProfileShort*>(striped_[0]),
+                                      seq2, seq2_len, &options);
+  }
+
+  return ToEnvUnits(score, options);
+}
+
+double Profile::TimeKernel(Kernel kernel, const AlignmentEnvironment& env,
+                           int len1, int len2) {
+  // residues as the sequences are encoded, the 20 standard amino acids
+  static const char kResidues[] = "ACDEFGHIKLMNPQRSTVWY";
+  std::mt19937 rng(len1 * 1000 + len2);
+  std::uniform_int_distribution<int> residue(0, 19);
+  auto random_seq = [&](int len) {
+    std::string seq(len, 0);
+    for (auto& c : seq) c = kResidues[residue(rng)] - 'A';
+    return seq;
+  };
+  const int kQueries = 4, kTargets = 8;
+  std::vector<std::string> queries, targets;
+  for (int i = 0; i < kQueries; i++) queries.push_back(random_seq(len1));
+  for (int i = 0; i < kTargets; i++) targets.push_back(random_seq(len2));
+
+  std::vector<std::unique_ptr<Profile>> profiles;
+  for (auto& query : queries) {
+    profiles.emplace_back(new Profile(query.data(), len1, env));
+    // builds the profile outside the timed runs
+    profiles.back()->ScoreWith(kernel, targets[0].data(), len2);
+  }
+
+  // about 256k cells per run, the best of a few runs since other work on
+  // the machine can only slow one down
+  const int64_t cells = int64_t(kQueries) * kTargets * len1 * len2;
+  const int reps = std::max<int64_t>(1, (1 << 18) / cells);
+  double best = DBL_MAX, sink = 0;
+  for (int run = 0; run < 3; run++) {
+    auto start = std::chrono::steady_clock::now();
+    for (int rep = 0; rep < reps; rep++) {
+      for (auto& profile : profiles) {
+        for (auto& target : targets) {
+          sink += profile->ScoreWith(kernel, target.data(), len2);
+        }
+      }
+    }
+    std::chrono::duration<double, std::nano> elapsed =
+        std::chrono::steady_clock::now() - start;
+    best = std::min(best, elapsed.count());
+  }
+  // keeps the scores from being optimized away
+  if (sink < 0) best = DBL_MAX;
+  return best / (double(cells) * reps);
+}
+
+agd::Status Profile::TuneKernels(const AlignmentEnvironment& env,
+                                 const std::string& tuning_file) {
+  using json = nlohmann::json;
+  const std::vector<int> bounds(kLengthBounds,
+                                kLengthBounds + kNumLengthClasses - 1);
+  KernelChoice choice = WidestStriped();
+
+  std::ifstream tuning_stream;
+  if (!tuning_file.empty()) {
+    tuning_stream.open(tuning_file);
+  }
+  if (tuning_stream.is_open()) {
+    json tuning_json;
+    std::vector<int> file_bounds;
+    std::vector<std::vector<std::string>> names;
+    try {
+      tuning_stream >> tuning_json;
+      auto bounds_it = tuning_json.find("length_bounds");
+      auto kernels_it = tuning_json.find("kernels");
+      if (bounds_it == tuning_json.end() || kernels_it == tuning_json.end()) {
+        return agd::errors::InvalidArgument(
+            "kernel tuning file ", tuning_file,
+            " needs length_bounds and kernels");
+      }
+      file_bounds = bounds_it->get<std::vector<int>>();
+      names = kernels_it->get<std::vector<std::vector<std::string>>>();
+    } catch (const json::exception& e) {
+      return agd::errors::InvalidArgument("kernel tuning file ", tuning_file,
+                                          " is malformed: ", e.what());
+    }
+    if (file_bounds != bounds) {
+      return agd::errors::InvalidArgument(
+          "kernel tuning file ", tuning_file,
+          " has other length classes, remove it to tune again");
+    }
+    if (names.size() != kNumLengthClasses) {
+      return agd::errors::InvalidArgument("kernel tuning file ", tuning_file,
+                                          " needs ", kNumLengthClasses,
+                                          " rows of kernels");
+    }
+    for (int c1 = 0; c1 < kNumLengthClasses; c1++) {
+      if (names[c1].size() != kNumLengthClasses) {
+        return agd::errors::InvalidArgument("kernel tuning file ",
+                                            tuning_file, " needs ",
+                                            kNumLengthClasses,
+                                            " kernels per row");
+      }
+      for (int c2 = 0; c2 < kNumLengthClasses; c2++) {
+        auto name = std::find(kKernelNames, kKernelNames + kNumKernels,
+                              names[c1][c2]);
+        if (name == kKernelNames + kNumKernels) {
+          return agd::errors::InvalidArgument(
+              "kernel tuning file ", tuning_file, " has unknown kernel ",
+              names[c1][c2]);
+        }
+        // a file tuned on another CPU keeps the widest striped kernel
+        // where it names one this CPU does not have
+        Kernel kernel = Kernel(name - kKernelNames);
+        if (Supported(kernel)) {
+          choice[c1][c2] = kernel;
+        }
+      }
+    }
+    kernel_choice = choice;
+    return agd::Status::OK();
+  }
+
+  // a kernel replaces the widest striped one of a class only if its median
+  // time over kTuningRounds rounds is kTuningMargin below that of the
+  // widest. a class where a kernel is faster by the margin in some rounds
+  // and not others is not conclusive, and the table is then not written
+  // so timing noise does not stick in the file
+  const Kernel widest = WidestStriped()[0][0];
+  bool decisive = true;
+  for (int c1 = 0; c1 < kNumLengthClasses; c1++) {
+    for (int c2 = 0; c2 < kNumLengthClasses; c2++) {
+      // time relative to the widest striped kernel, per kernel and round.
+      // only set for supported kernels, the others are never timed
+      std::array<std::array<double, kTuningRounds>, kNumKernels> ratios{};
+      for (int round = 0; round < kTuningRounds; round++) {
+        std::array<double, kNumKernels> ns{};
+        for (int k = 0; k < kNumKernels; k++) {
+          if (Supported(Kernel(k))) {
+            ns[k] = TimeKernel(Kernel(k), env, kTimedLengths[c1],
+                               kTimedLengths[c2]);
+          }
+        }
+        for (int k = 0; k < kNumKernels; k++) {
+          if (Supported(Kernel(k))) {
+            ratios[k][round] = ns[k] / ns[int(widest)];
+          }
+        }
+      }
+      // of the kernels that win, the first in kTuningPreference, their
+      // order by time is as noisy as the times
+      for (Kernel kernel : kTuningPreference) {
+        if (kernel == widest || !Supported(kernel)) {
+          continue;
+        }
+        auto& r = ratios[int(kernel)];
+        std::sort(r.begin(), r.end());
+        if (r.front() < 1 - kTuningMargin && r.back() >= 1 - kTuningMargin) {
+          decisive = false;
+        }
+        if (r[kTuningRounds / 2] < 1 - kTuningMargin &&
+            choice[c1][c2] == widest) {
+          choice[c1][c2] = kernel;
+        }
+      }
+    }
+  }
+  kernel_choice = choice;
+
+  if (!tuning_file.empty() && decisive) {
+    json tuning_json;
+    tuning_json["length_bounds"] = bounds;
+    std::vector<std::vector<std::string>> names(kNumLengthClasses);
+    for (int c1 = 0; c1 < kNumLengthClasses; c1++) {
+      for (int c2 = 0; c2 < kNumLengthClasses; c2++) {
+        names[c1].push_back(kKernelNames[int(choice[c1][c2])]);
+      }
+    }
+    tuning_json["kernels"] = names;
+    std::ofstream out(tuning_file);
+    if (!out.good()) {
+      return agd::errors::Internal("could not write kernel tuning file ",
+                                   tuning_file);
+    }
+    out << tuning_json.dump(2) << "\n";
+  }
+  return agd::Status::OK();
+}
+
+std::string Profile::KernelTable() {
+  std::string table = "query \\ target";
+  for (int c = 0; c < kNumLengthClasses; c++) {
+    table += c < kNumLengthClasses - 1
+                 ? absl::StrCat(" <=", kLengthBounds[c])
+                 : absl::StrCat(" >", kLengthBounds[c - 1]);
+  }
+  for (int c1 = 0; c1 < kNumLengthClasses; c1++) {
+    table += c1 < kNumLengthClasses - 1
+                 ? absl::StrCat("\n<=", kLengthBounds[c1], ":")
+                 : absl::StrCat("\n>", kLengthBounds[c1 - 1], ":");
+    for (int c2 = 0; c2 < kNumLengthClasses; c2++) {
+      absl::StrAppend(&table, " ", kKernelNames[int(kernel_choice[c1][c2])]);
+    }
+  }
+  return table;
+}
+
+double Profile::ScoreBound(const char* seq2, int seq2_len) const {
+  if (!env_->int8_bound) {
+    return SHRT_MAX;
+  }
+
+  Options options;
+  options.gapOpen = env_->gap_open_int8;
+  options.gapExt = env_->gap_ext_int8;
+  options.threshold = env_->threshold;
+
+  double score;
+  switch (short_kernel) {
+    case ShortKernel::AVX512BW:
+      if (!byte_) {
+        byte_ = swps3_createProfileByteAVX512(seq_, seq_len_,
+                                              env_->matrix_int8);
+      }
+      score = swps3_alignmentByteAVX512(static_cast<ProfileByteAVX*>(byte_),
+                                        seq2, seq2_len, &options);
+      break;
+    case ShortKernel::AVX2:
+      if (!byte_) {
+        byte_ = swps3_createProfileByteAVX2(seq_, seq_len_, env_->matrix_int8);
+      }
+      score = swps3_alignmentByteAVX2(static_cast<ProfileByteAVX*>(byte_),
+                                      seq2, seq2_len, &options);
+      break;
+    default:
+      if (!byte_) {
+        byte_ = swps3_createProfileByteSSE(seq_, seq_len_, env_->matrix_int8);
+      }
+      score = swps3_alignmentByteSSE(static_cast<ProfileByte*>(byte_), seq2,
+                                     seq2_len, &options);
+  }
+  if (score >= FLT_MAX) {
+    return SHRT_MAX;
+  }
+
+  // the best int16 alignment scores at most `score` in int8, and has at
+  // most min(len) aligned pairs and len + len2 positions
+  double bound = env_->int8_ratio * score +
+                 std::min(seq_len_, seq2_len) * env_->int8_match_err +
+                 (seq_len_ + seq2_len) * env_->int8_gap_err;
+  // int16 scores are integers, the epsilon covers rounding in the above
+  bound = std::floor(bound + 1e-6);
+  if (bound >= 65534) {
+    // the int16 kernel could saturate (65535)
+    return SHRT_MAX;
+  }
+  return ToEnvUnits(bound, options);
+}
+
+namespace {
+
+// code of the 3-mer at seq, -1 if it has a residue outside the matrix
+int SeedCode(const char* seq) {
+  int code = 0;
+  for (int i = 0; i < 3; i++) {
+    if (seq[i] < 0 || seq[i] >= MATRIX_DIM) {
+      return -1;
+    }
+    code = code * MATRIX_DIM + seq[i];
+  }
+  return code;
+}
+
+}  // namespace
+
+double Profile::UngappedScore(const char* seq2, int seq2_len, double x_drop,
+                              double enough) const {
+  if (seeds_.empty()) {
+    for (int i = 0; i + 3 <= seq_len_; i++) {
+      int code = SeedCode(seq_ + i);
+      if (code >= 0) {
+        seeds_.push_back(uint64_t(code) << 32 | uint32_t(i));
+      }
+    }
+    std::sort(seeds_.begin(), seeds_.end());
+  }
+  diag_end_.assign(seq_len_ + seq2_len, 0);
+
+  // same units as the int16 kernel, whose raw score can only be higher
+  Options options;
+  options.threshold = env_->threshold;
+  const double scale = 65535.0f / options.threshold;
+  const int64_t drop = int64_t(x_drop * scale);
+  // the kernel saturates at 65535 too
+  const int64_t stop = int64_t(std::min(std::ceil(enough * scale), 65535.0));
+  const int16_t* matrix = env_->matrix_int16;
+
+  int64_t best = 0;
+  for (int j = 0; j + 3 <= seq2_len && best < stop; j++) {
+    int code = SeedCode(seq2 + j);
+    if (code < 0) {
+      continue;
+    }
+    auto it = std::lower_bound(seeds_.begin(), seeds_.end(),
+                               uint64_t(code) << 32);
+    for (; it != seeds_.end() && int(*it >> 32) == code; ++it) {
+      int i = uint32_t(*it);
+      int& end = diag_end_[i - j + seq2_len - 1];
+      if (i < end) {
+        // inside an earlier extension on this diagonal
+        continue;
+      }
+      // right from the seed, then left of it
+      int64_t score = 0, right = 0;
+      int k = 0;
+      for (; i + k < seq_len_ && j + k < seq2_len; k++) {
+        score += matrix[seq_[i + k] * MATRIX_DIM + seq2[j + k]];
+        right = std::max(right, score);
+        if (right - score > drop) {
+          break;
+        }
+      }
+      end = i + k + 1;
+      score = 0;
+      int64_t left = 0;
+      for (k = 1; k <= i && k <= j; k++) {
+        score += matrix[seq_[i - k] * MATRIX_DIM + seq2[j - k]];
+        left = std::max(left, score);
+        if (left - score > drop) {
+          break;
+        }
+      }
+      best = std::max(best, left + right);
+      if (best >= stop) {
+        break;
+      }
+    }
+  }
+
+  if (best >= 65535) {
+    return SHRT_MAX;
+  }
+  return ToEnvUnits(best, options);
+}
+
+void Profile::ScoreBatch(const char* const* seqs, const int* seq_lens, int n,
+                         double* scores) const {
+  const int width = BatchWidth();
+  if (width == 1) {
+    for (int i = 0; i < n; i++) {
+      scores[i] = Score(seqs[i], seq_lens[i]);
+    }
+    return;
+  }
+
+  auto* batch = static_cast<ProfileShortBatch*>(batch_);
+  if (!batch) {
+    // scratch is sized to the query, build once per profile
+    batch = swps3_createProfileShortBatchAVX512(seq_, seq_len_,
+                                                env_->matrix_int16);
+    batch_ = batch;
+  }
+
+  Options options;
+  options.gapOpen = env_->gap_open_int16;
+  options.gapExt = env_->gap_ext_int16;
+  options.threshold = env_->threshold;
+
+  // a batch runs as long as its longest target, so give each batch
+  // targets of similar length
+  std::vector<int> order(n);
+  for (int i = 0; i < n; i++) order[i] = i;
+  std::sort(order.begin(), order.end(),
+            [seq_lens](int a, int b) { return seq_lens[a] < seq_lens[b]; });
+
+  std::vector<const char*> db(width);
+  std::vector<int> db_lens(width);
+  std::vector<double> db_scores(width);
+  for (int start = 0; start < n; start += width) {
+    int count = std::min(width, n - start);
+    if (count < width / 2) {
+      // mostly idle lanes, the striped kernel is faster
+      for (int k = start; k < n; k++) {
+        scores[order[k]] = Score(seqs[order[k]], seq_lens[order[k]]);
+      }
+      break;
+    }
+    for (int k = 0; k < count; k++) {
+      db[k] = seqs[order[start + k]];
+      db_lens[k] = seq_lens[order[start + k]];
+    }
+    swps3_alignmentShortBatchAVX512(batch, db.data(), db_lens.data(), count,
+                                    &options, db_scores.data());
+    for (int k = 0; k < count; k++) {
+      scores[order[start + k]] = ToEnvUnits(db_scores[k], options);
+    }
+  }
+}
+
+const Profile& ProfileCache::Get(uint32_t seq_id, const char* seq,
+                                 int seq_len) {
+  auto& profile = profiles_[seq_id];
+  if (!profile) {
+    profile.reset(new Profile(seq, seq_len, *env_));
+  }
+  return *profile;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "absl/container/flat_hash_map.h"
+#include "alignment_environment.h"
+
+// int16 and int8 query profiles of one sequence under one environment, built
+// for the kernels this CPU has (SSE2, AVX2 or AVX-512BW) on first use.
+// Building one costs O(len * MATRIX_DIM) and a malloc, so a query aligned
+// against many targets should only be profiled once.
+class Profile {
+ public:
+  // the int16 kernels Score() picks from
+  enum class Kernel { Striped8, Striped16, Striped32, Diag16, Diag32 };
+
+  Profile(const char* seq, int seq_len, const AlignmentEnvironment& env);
+  ~Profile();
+
+  // owns swps3 memory, no copy
+  Profile(const Profile& other) = delete;
+  Profile& operator=(const Profile& other) = delete;
+
+  // int16 local alignment score against seq2, scaled back to env units
+  // the profile holds the kernel scratch rows, so one thread at a time.
+  // the kernel is picked by the query and target length, see TuneKernels
+  double Score(const char* seq2, int seq2_len) const;
+
+  // upper bound of Score() from the int8 kernel, which has twice the lanes.
+  // SHRT_MAX if the int8 score saturates or the env has no int8 bound
+  double ScoreBound(const char* seq2, int seq2_len) const;
+
+  // best ungapped local alignment score against seq2, extended with X-drop
+  // x_drop (env units) from every exact 3-mer the two share. a lower bound
+  // of Score(), returns as soon as it reaches enough
+  double UngappedScore(const char* seq2, int seq2_len, double x_drop,
+                       double enough) const;
+
+  // Score() of seqs[0..n) into scores, BatchWidth() targets per kernel call
+  void ScoreBatch(const char* const* seqs, const int* seq_lens, int n,
+                  double* scores) const;
+
+  const AlignmentEnvironment& Env() const { return *env_; }
+
+  static const char* KernelName();
+
+  // picks the int16 kernel Score() uses for each query and target length
+  // class among the striped kernels of every width the CPU has and the anti
+  // diagonal ones, which all give the same scores. loaded from tuning_file
+  // if it exists, else timed on random sequences under env, keeping the
+  // widest striped kernel unless another is clearly faster, and written to
+  // tuning_file unless that is empty or the timings were not conclusive.
+  // until called Score() always uses the widest striped kernel. not thread
+  // safe, call before aligning
+  static agd::Status TuneKernels(const AlignmentEnvironment& env,
+                                 const std::string& tuning_file);
+
+  // the kernel of each length class, a line per query length class
+  static std::string KernelTable();
+
+  // targets aligned at once by the inter-sequence (one target per lane)
+  // kernel. Only AVX-512BW can look up a lane's score in one instruction,
+  // elsewhere the striped kernel is faster and this is 1.
+  static int BatchWidth();
+
+ private:
+  double ScoreWith(Kernel kernel, const char* seq2, int seq2_len) const;
+
+  // ns per cell of kernel for random len1 x len2 pairs
+  static double TimeKernel(Kernel kernel, const AlignmentEnvironment& env,
+                           int len1, int len2);
+
+  const AlignmentEnvironment* env_;
+  const char* seq_;  // not owned, must outlive the profile
+  int seq_len_;
+  // all built on first use
+  // ProfileShort (SSE2) or ProfileShortAVX (AVX2, AVX-512BW) per width
+  mutable void* striped_[3] = {nullptr, nullptr, nullptr};
+  mutable void* diag_ = nullptr;     // ProfileShortDiag
+  mutable void* byte_ = nullptr;     // ProfileByte or ProfileByteAVX
+  mutable void* batch_ = nullptr;    // ProfileShortBatch
+  // 3-mers of seq_ as code << 32 | position, sorted, and the end of the
+  // last extension on each diagonal of the current UngappedScore target
+  mutable std::vector<uint64_t> seeds_;
+  mutable std::vector<int> diag_end_;
+};
+
+// Per thread cache of query profiles, keyed by absolute sequence index.
+// Merge code profiles the cluster rep once and aligns it against every
+// rep / member of the other side, then calls Clear() at the end of the
+// work item so memory stays bounded.
+class ProfileCache {
+ public:
+  explicit ProfileCache(const AlignmentEnvironment& env) : env_(&env) {}
+
+  // profile for seq, built on first use. Valid until Clear().
+  const Profile& Get(uint32_t seq_id, const char* seq, int seq_len);
+
+  void Clear() { profiles_.clear(); }
+
+  size_t Size() const { return profiles_.size(); }
+
+ private:
+  const AlignmentEnvironment* env_;
+  absl::flat_hash_map<uint32_t, std::unique_ptr<Profile>> profiles_;
+};
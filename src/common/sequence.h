@@ -1,6 +1,10 @@
 
 #pragma once
 
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <vector>
 #include "absl/strings/string_view.h"
 
 class Sequence {
@@ -11,7 +15,9 @@ class Sequence {
         genome_(genome),
         genome_size_(genome_size),
         genome_index_(genome_index),
-        id_(id) {}
+        id_(id) {
+    SetComposition();
+  }
 
   Sequence(const Sequence& other) = default;
   // not sure if move is even necessary, since members
@@ -24,10 +30,56 @@ class Sequence {
   absl::string_view Seq() const { return sequence_; }
   uint32_t ID() const { return id_; }
 
+  // upper bounds of this sequence's threshold score against any other,
+  // under the just score and logpam just score envs. set at load time by
+  // ProteinAligner::SetScoreBounds, never prune until then
+  double ScoreBound() const { return score_bound_; }
+  double LogPamScoreBound() const { return logpam_score_bound_; }
+  void SetScoreBounds(double score_bound, double logpam_score_bound) {
+    score_bound_ = score_bound;
+    logpam_score_bound_ = logpam_score_bound;
+  }
+
+  // fraction of each of the 20 standard amino acids, in ARNDCQEGHILKMFPSTWYV
+  // order, among the standard residues of the sequence. 16 byte aligned
+  // for SIMD
+  static const int kCompositionSize = 20;
+  const float* Composition() const { return composition_; }
+
+  // sorted reduced alphabet k-mers with their positions, see KmerFilter.
+  // empty unless Parameters::kmer_size is set
+  const std::vector<uint64_t>& Kmers() const { return kmers_; }
+  void SetKmers(std::vector<uint64_t> kmers) { kmers_ = std::move(kmers); }
+
  private:
+  void SetComposition() {
+    static const char kAminoAcids[] = "ARNDCQEGHILKMFPSTWYV";
+    int bin[26];
+    std::fill(bin, bin + 26, -1);
+    for (int i = 0; i < kCompositionSize; i++) {
+      bin[kAminoAcids[i] - 'A'] = i;
+    }
+    int counts[kCompositionSize] = {0};
+    int total = 0;
+    for (char c : sequence_) {
+      // residues are stored as offsets from 'A'
+      if (c >= 0 && c < 26 && bin[int(c)] >= 0) {
+        counts[bin[int(c)]]++;
+        total++;
+      }
+    }
+    for (int i = 0; i < kCompositionSize; i++) {
+      composition_[i] = total > 0 ? float(counts[i]) / total : 0.0f;
+    }
+  }
+
   absl::string_view sequence_;
   const std::string& genome_;
   uint32_t genome_size_;
   uint32_t genome_index_;
   uint32_t id_; // absolute index 
+  double score_bound_ = SHRT_MAX;
+  double logpam_score_bound_ = SHRT_MAX;
+  std::vector<uint64_t> kmers_;
+  alignas(16) float composition_[kCompositionSize];
 };
\ No newline at end of file
@@ -0,0 +1,69 @@
+#include "set_pairing.h"
+#include <algorithm>
+#include <iterator>
+
+bool SetPairing::ParsePolicy(const std::string& name, Policy* policy) {
+  if (name == "fifo") {
+    *policy = Policy::kFifo;
+  } else if (name == "smallest") {
+    *policy = Policy::kSmallest;
+  } else if (name == "balanced") {
+    *policy = Policy::kBalanced;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void SetPairing::Push(std::unique_ptr<ClusterSet> set, int depth) {
+  size_t size = policy_ == Policy::kFifo ? 0 : set->Size();
+  auto& entry = entries_[Key(size, num_pushed_++)];
+  entry.depth = depth;
+  entry.set = std::move(set);
+}
+
+bool SetPairing::Pop(size_t num_running, std::unique_ptr<ClusterSet>* s1,
+                     std::unique_ptr<ClusterSet>* s2, int* depth) {
+  if (entries_.size() < 2) {
+    return false;
+  }
+  auto first = entries_.begin();
+  if (policy_ == Policy::kBalanced) {
+    // of the sets in size order, the first two neighbours within the
+    // ratio. a set that is not within it of its larger neighbour is not
+    // within it of any larger set
+    auto it = entries_.begin();
+    for (; std::next(it) != entries_.end(); ++it) {
+      size_t smaller = std::max<size_t>(it->first.first, 1);
+      if (std::next(it)->first.first <= max_imbalance_ * smaller) {
+        break;
+      }
+    }
+    if (std::next(it) != entries_.end()) {
+      first = it;
+    } else if (num_running > 0) {
+      // a running merge may yield a partner
+      return false;
+    }
+  }
+  auto second = std::next(first);
+
+  *depth = std::max(first->second.depth, second->second.depth);
+  *s1 = std::move(first->second.set);
+  *s2 = std::move(second->second.set);
+  entries_.erase(first, std::next(second));
+  return true;
+}
+
+const ClusterSet* SetPairing::PeekLast() const {
+  return entries_.size() == 1 ? entries_.begin()->second.set.get() : nullptr;
+}
+
+std::unique_ptr<ClusterSet> SetPairing::TakeLast() {
+  if (entries_.size() != 1) {
+    return nullptr;
+  }
+  auto set = std::move(entries_.begin()->second.set);
+  entries_.clear();
+  return set;
+}
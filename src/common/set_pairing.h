@@ -0,0 +1,55 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include "cluster_set.h"
+
+// the cluster sets BottomUpMerge::RunMulti has left to merge, and which two
+// of them it merges next
+class SetPairing {
+ public:
+  enum class Policy {
+    kFifo,      // the two oldest sets, the order sets were always merged in
+    kSmallest,  // the two with the least clusters (Huffman)
+    kBalanced,  // two whose cluster counts are within max_imbalance
+  };
+
+  // fifo, smallest or balanced
+  static bool ParsePolicy(const std::string& name, Policy* policy);
+
+  // max_imbalance is the largest ratio of the cluster counts of two sets
+  // kBalanced merges while other merges are still running
+  SetPairing(Policy policy, float max_imbalance)
+      : policy_(policy), max_imbalance_(max_imbalance) {}
+
+  // a set to merge, depth is its height in the merge tree (0 for a leaf)
+  void Push(std::unique_ptr<ClusterSet> set, int depth);
+
+  // the next two sets to merge and the larger of their depths, false if
+  // there are none or kBalanced finds no pair and would rather wait for
+  // one of the num_running merges
+  bool Pop(size_t num_running, std::unique_ptr<ClusterSet>* s1,
+           std::unique_ptr<ClusterSet>* s2, int* depth);
+
+  // the set left once all are merged, nullptr unless there is exactly one
+  const ClusterSet* PeekLast() const;
+  std::unique_ptr<ClusterSet> TakeLast();
+
+  size_t Size() const { return entries_.size(); }
+
+ private:
+  struct Entry {
+    int depth;
+    std::unique_ptr<ClusterSet> set;
+  };
+  // (clusters, push count), clusters is 0 for kFifo so the map is in push
+  // order, else in size order with ties in push order
+  typedef std::pair<size_t, uint64_t> Key;
+
+  Policy policy_;
+  float max_imbalance_;
+  uint64_t num_pushed_ = 0;
+  std::map<Key, Entry> entries_;
+};
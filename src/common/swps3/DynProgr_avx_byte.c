@@ -0,0 +1,171 @@
+/** \file DynProgr_avx_byte.c
+ *
+ * Profile generation and alignment for packed byte vectors on AVX2 and
+ * AVX-512BW. The alignment body lives in DynProgr_avx_byte.inc and is
+ * instantiated once per instruction set.
+ */
+
+#include "DynProgr_avx_byte.h"
+#include <stdlib.h>
+#include <float.h>
+#include <immintrin.h>
+
+#define VEC_ALIGN 64
+
+static ProfileByteAVX * createProfileByteAVX(const char * query,
+		int queryLen, BMatrix matrix, int lanes) {
+	int segLen = (queryLen + lanes - 1) / lanes;
+	int i, j, k;
+	int bias = 0;
+	uint8_t * pprofile;
+	size_t vecs = (size_t) segLen * (MATRIX_DIM + 3);
+	ProfileByteAVX * profile = malloc(sizeof(ProfileByteAVX));
+
+	profile->mem = malloc(vecs * lanes + VEC_ALIGN);
+	profile->loadOpt = (uint8_t *) (((size_t) profile->mem + VEC_ALIGN - 1)
+			& ~(size_t) (VEC_ALIGN - 1));
+	profile->storeOpt = profile->loadOpt + segLen * lanes;
+	profile->rD = profile->storeOpt + segLen * lanes;
+	profile->profile = profile->rD + segLen * lanes;
+
+	profile->len = queryLen;
+	profile->lanes = lanes;
+	profile->segLen = segLen;
+
+	/* same bias as the SSE profile */
+	for (i = 0; i < MATRIX_DIM; i++)
+		for (j = 0; j < MATRIX_DIM; j++)
+			if (bias < -matrix[i * MATRIX_DIM + j])
+				bias = -matrix[i * MATRIX_DIM + j];
+
+	pprofile = profile->profile;
+	for (i = 0; i < MATRIX_DIM; i++)
+		for (j = 0; j < segLen; j++)
+			for (k = 0; k < lanes; k++)
+				if (j + k * segLen < queryLen)
+					*(pprofile++) = matrix[query[j + k * segLen] * MATRIX_DIM
+							+ i] + bias;
+				else
+					*(pprofile++) = bias;
+	profile->bias = bias;
+	return profile;
+}
+
+EXPORT ProfileByteAVX * swps3_createProfileByteAVX2(const char * query,
+		int queryLen, BMatrix matrix) {
+	return createProfileByteAVX(query, queryLen, matrix, 32);
+}
+
+EXPORT ProfileByteAVX * swps3_createProfileByteAVX512(const char * query,
+		int queryLen, BMatrix matrix) {
+	return createProfileByteAVX(query, queryLen, matrix, 64);
+}
+
+EXPORT void swps3_freeProfileByteAVX(ProfileByteAVX * profile) {
+	free(profile->mem);
+	free(profile);
+}
+
+/* AVX2, 32 lanes */
+/******************/
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+static inline __m256i shiftByteAVX2(__m256i v) {
+	/* zero below the low 128 of v, then shift everything one byte up */
+	__m256i t = _mm256_permute2x128_si256(v, v, 0x08);
+	return _mm256_alignr_epi8(v, t, 15);
+}
+
+static inline unsigned char hmaxByteAVX2(__m256i v) {
+	__m128i x = _mm_max_epu8(_mm256_castsi256_si128(v),
+			_mm256_extracti128_si256(v, 1));
+	x = _mm_max_epu8(x, _mm_srli_si128(x, 8));
+	x = _mm_max_epu8(x, _mm_srli_si128(x, 4));
+	x = _mm_max_epu8(x, _mm_srli_si128(x, 2));
+	x = _mm_max_epu8(x, _mm_srli_si128(x, 1));
+	return (unsigned char) _mm_extract_epi16(x, 0);
+}
+
+#define VEC __m256i
+#define LANES 32
+#define V_LOAD(p) _mm256_load_si256(p)
+#define V_STORE(p, v) _mm256_store_si256(p, v)
+#define V_SET1(x) _mm256_set1_epi8(x)
+#define V_ADDS(a, b) _mm256_adds_epu8(a, b)
+#define V_SUBS(a, b) _mm256_subs_epu8(a, b)
+#define V_MAX(a, b) _mm256_max_epu8(a, b)
+#define V_SHIFT(v) shiftByteAVX2(v)
+#define V_ALL_EQ(a, b) (_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b)) == -1)
+#define V_HMAX(v) hmaxByteAVX2(v)
+#define NAME(x) x##AVX2
+
+#include "DynProgr_avx_byte.inc"
+
+#undef VEC
+#undef LANES
+#undef V_LOAD
+#undef V_STORE
+#undef V_SET1
+#undef V_ADDS
+#undef V_SUBS
+#undef V_MAX
+#undef V_SHIFT
+#undef V_ALL_EQ
+#undef V_HMAX
+#undef NAME
+
+#pragma GCC pop_options
+
+/* AVX-512BW, 64 lanes */
+/***********************/
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512bw")
+
+static inline __m512i shiftByteAVX512(__m512i v) {
+	/* 128 bit lane k of t is lane k-1 of v, lane 0 is zero */
+	__m512i t = _mm512_alignr_epi64(v, _mm512_setzero_si512(), 6);
+	return _mm512_alignr_epi8(v, t, 15);
+}
+
+static inline unsigned char hmaxByteAVX512(__m512i v) {
+	__m256i y = _mm256_max_epu8(_mm512_castsi512_si256(v),
+			_mm512_extracti64x4_epi64(v, 1));
+	__m128i x = _mm_max_epu8(_mm256_castsi256_si128(y),
+			_mm256_extracti128_si256(y, 1));
+	x = _mm_max_epu8(x, _mm_srli_si128(x, 8));
+	x = _mm_max_epu8(x, _mm_srli_si128(x, 4));
+	x = _mm_max_epu8(x, _mm_srli_si128(x, 2));
+	x = _mm_max_epu8(x, _mm_srli_si128(x, 1));
+	return (unsigned char) _mm_extract_epi16(x, 0);
+}
+
+#define VEC __m512i
+#define LANES 64
+#define V_LOAD(p) _mm512_load_si512(p)
+#define V_STORE(p, v) _mm512_store_si512(p, v)
+#define V_SET1(x) _mm512_set1_epi8(x)
+#define V_ADDS(a, b) _mm512_adds_epu8(a, b)
+#define V_SUBS(a, b) _mm512_subs_epu8(a, b)
+#define V_MAX(a, b) _mm512_max_epu8(a, b)
+#define V_SHIFT(v) shiftByteAVX512(v)
+#define V_ALL_EQ(a, b) (_mm512_cmpeq_epi8_mask(a, b) == ~(__mmask64) 0)
+#define V_HMAX(v) hmaxByteAVX512(v)
+#define NAME(x) x##AVX512
+
+#include "DynProgr_avx_byte.inc"
+
+#undef VEC
+#undef LANES
+#undef V_LOAD
+#undef V_STORE
+#undef V_SET1
+#undef V_ADDS
+#undef V_SUBS
+#undef V_MAX
+#undef V_SHIFT
+#undef V_ALL_EQ
+#undef V_HMAX
+#undef NAME
+
+#pragma GCC pop_options
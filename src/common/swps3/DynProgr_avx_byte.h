@@ -0,0 +1,35 @@
+/** \file DynProgr_avx_byte.h
+ *
+ * Profile generation and alignment for packed byte vectors on AVX2 (32 lanes)
+ * and AVX-512BW (64 lanes). Same algorithm and results as
+ * DynProgr_sse_byte.h, only the number of lanes differs.
+ *
+ * The kernels are compiled with target attributes, callers must check
+ * the CPU before using them.
+ */
+
+#ifndef AVX_BYTE_H
+#define AVX_BYTE_H
+
+#include "swps3.h"
+#include "matrix.h"
+
+typedef struct{
+	int len;
+	int lanes /** 32 for AVX2, 64 for AVX-512BW */;
+	int segLen;
+	unsigned char bias;
+	uint8_t * profile;
+	uint8_t * rD;
+	uint8_t * storeOpt;
+	uint8_t * loadOpt;
+	void * mem;
+} ProfileByteAVX;
+
+ProfileByteAVX * swps3_createProfileByteAVX2( const char * query, int queryLen, BMatrix matrix );
+ProfileByteAVX * swps3_createProfileByteAVX512( const char * query, int queryLen, BMatrix matrix );
+double swps3_alignmentByteAVX2( ProfileByteAVX * query, const char * db, int dbLen, Options * options );
+double swps3_alignmentByteAVX512( ProfileByteAVX * query, const char * db, int dbLen, Options * options );
+void swps3_freeProfileByteAVX( ProfileByteAVX * profile );
+
+#endif /* AVX_BYTE_H */
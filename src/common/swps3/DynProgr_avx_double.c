@@ -0,0 +1,153 @@
+/** \file DynProgr_avx_double.c
+ *
+ * Profile generation and local alignment for packed doubles on AVX2 and
+ * AVX-512F. The alignment body lives in DynProgr_avx_double.inc and is
+ * instantiated once per instruction set.
+ */
+
+#include "DynProgr_avx_double.h"
+#include <stdlib.h>
+#include <float.h>
+#include <immintrin.h>
+
+#define VEC_ALIGN 64
+
+ProfileDoubleAVX* updateProfileDoubleAVX(ProfileDoubleAVX* profile,
+		const char* s1, int ls1, double* matrix, int lanes) {
+	int segLen = (ls1 + lanes - 1) / lanes;
+	int i, j, k;
+	size_t row = (size_t) segLen * lanes;
+	size_t size = (row * (MATRIX_DIM + 6)) * sizeof(double) + VEC_ALIGN;
+	double* pprofile;
+
+	if (profile == NULL) {
+		profile = malloc(sizeof(ProfileDoubleAVX));
+		profile->mem = NULL;
+		profile->mem_size = 0;
+	}
+	if (profile->mem_size < size) {
+		free(profile->mem);
+		profile->mem = malloc(size);
+		profile->mem_size = size;
+	}
+	profile->old_opt = (double*) (((size_t) profile->mem + VEC_ALIGN - 1)
+			& ~(size_t) (VEC_ALIGN - 1));
+	profile->new_opt = profile->old_opt + row;
+	profile->new_rd = profile->new_opt + row;
+	profile->old_org = profile->new_rd + row;
+	profile->new_org = profile->old_org + row;
+	profile->rd_org = profile->new_org + row;
+	profile->profile = profile->rd_org + row;
+
+	profile->ls1 = ls1;
+	profile->lanes = lanes;
+	profile->segLen = segLen;
+
+	/* row j + k * segLen of s1 goes to lane k, rows past the end score 0
+	 * like in createProfileDoubleSSE */
+	pprofile = profile->profile;
+	for (i = 0; i < MATRIX_DIM; i++)
+		for (j = 0; j < segLen; j++)
+			for (k = 0; k < lanes; k++)
+				if (j + k * segLen < ls1)
+					*(pprofile++) = matrix[s1[j + k * segLen] * MATRIX_DIM + i];
+				else
+					*(pprofile++) = 0;
+	return profile;
+}
+
+ProfileDoubleAVX* createProfileDoubleAVX2(const char* s1, int ls1,
+		double* matrix) {
+	return updateProfileDoubleAVX(NULL, s1, ls1, matrix, 4);
+}
+
+ProfileDoubleAVX* createProfileDoubleAVX512(const char* s1, int ls1,
+		double* matrix) {
+	return updateProfileDoubleAVX(NULL, s1, ls1, matrix, 8);
+}
+
+void free_profile_double_avx(ProfileDoubleAVX* profile) {
+	free(profile->mem);
+	free(profile);
+}
+
+/* AVX2, 4 lanes */
+/*****************/
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+static inline __m256d shiftDoubleAVX2(__m256d v, __m256d fill) {
+	return _mm256_blend_pd(_mm256_permute4x64_pd(v, 0x90), fill, 1);
+}
+
+#define VEC __m256d
+#define LANES 4
+#define V_LOAD(p) _mm256_load_pd(p)
+#define V_STORE(p, v) _mm256_store_pd(p, v)
+#define V_SET1(x) _mm256_set1_pd(x)
+#define V_ZERO() _mm256_setzero_pd()
+#define V_ADD(a, b) _mm256_add_pd(a, b)
+#define V_MAX(a, b) _mm256_max_pd(a, b)
+#define V_SHIFT(v, f) shiftDoubleAVX2(v, f)
+#define V_ANY_GE(a, b) _mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_GE_OQ))
+#define V_SEL_GT(a, b, x, y) \
+	_mm256_blendv_pd(y, x, _mm256_cmp_pd(a, b, _CMP_GT_OQ))
+#define NAME(x) x##_avx2
+
+#include "DynProgr_avx_double.inc"
+
+#undef VEC
+#undef LANES
+#undef V_LOAD
+#undef V_STORE
+#undef V_SET1
+#undef V_ZERO
+#undef V_ADD
+#undef V_MAX
+#undef V_SHIFT
+#undef V_ANY_GE
+#undef V_SEL_GT
+#undef NAME
+
+#pragma GCC pop_options
+
+/* AVX-512F, 8 lanes */
+/*********************/
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+
+static inline __m512d shiftDoubleAVX512(__m512d v, __m512d fill) {
+	const __m512i idx = _mm512_set_epi64(6, 5, 4, 3, 2, 1, 0, 0);
+	return _mm512_mask_permutexvar_pd(fill, 0xFE, idx, v);
+}
+
+#define VEC __m512d
+#define LANES 8
+#define V_LOAD(p) _mm512_load_pd(p)
+#define V_STORE(p, v) _mm512_store_pd(p, v)
+#define V_SET1(x) _mm512_set1_pd(x)
+#define V_ZERO() _mm512_setzero_pd()
+#define V_ADD(a, b) _mm512_add_pd(a, b)
+#define V_MAX(a, b) _mm512_max_pd(a, b)
+#define V_SHIFT(v, f) shiftDoubleAVX512(v, f)
+#define V_ANY_GE(a, b) _mm512_cmp_pd_mask(a, b, _CMP_GE_OQ)
+#define V_SEL_GT(a, b, x, y) \
+	_mm512_mask_blend_pd(_mm512_cmp_pd_mask(a, b, _CMP_GT_OQ), y, x)
+#define NAME(x) x##_avx512
+
+#include "DynProgr_avx_double.inc"
+
+#undef VEC
+#undef LANES
+#undef V_LOAD
+#undef V_STORE
+#undef V_SET1
+#undef V_ZERO
+#undef V_ADD
+#undef V_MAX
+#undef V_SHIFT
+#undef V_ANY_GE
+#undef V_SEL_GT
+#undef NAME
+
+#pragma GCC pop_options
@@ -0,0 +1,62 @@
+/*
+ * DynProgr_avx_double.h
+ *
+ * Striped double precision local alignment on AVX2 (4 lanes) and AVX-512F
+ * (8 lanes). Same scores and max positions as align_double_local in
+ * DynProgr_sse_double.c, which only has 2 lanes.
+ *
+ * The kernels are compiled with target attributes, callers must check
+ * the CPU before using them.
+ */
+
+#ifndef DYNPROGR_AVX_DOUBLE_H_
+#define DYNPROGR_AVX_DOUBLE_H_
+
+#include <stddef.h>
+#include "swps3.h"
+
+typedef struct{
+	int ls1;
+	int lanes;
+	int segLen;
+	double* profile;
+	double* old_opt;
+	double* new_opt;
+	double* new_rd;
+	/* where the best path into each cell starts, for the _origin kernels */
+	double* old_org;
+	double* new_org;
+	double* rd_org;
+	void* mem;
+	size_t mem_size;
+} ProfileDoubleAVX;
+
+ProfileDoubleAVX* createProfileDoubleAVX2(const char* s1, int ls1, double* matrix);
+ProfileDoubleAVX* createProfileDoubleAVX512(const char* s1, int ls1, double* matrix);
+
+/* rebuild profile (may be NULL) for s1 with the given lanes (4 for AVX2,
+ * 8 for AVX-512F). the memory is only reallocated if it has to grow */
+ProfileDoubleAVX* updateProfileDoubleAVX(ProfileDoubleAVX* profile,
+		const char* s1, int ls1, double* matrix, int lanes);
+
+/* unlike align_double_local, these do not fill the BTData rows, nothing
+ * reads them after a local alignment */
+double align_double_local_avx2(ProfileDoubleAVX* profile, const char *s2, int ls2,
+		double gap_open, double gap_ext, double threshold, int* max1, int* max2);
+double align_double_local_avx512(ProfileDoubleAVX* profile, const char *s2, int ls2,
+		double gap_open, double gap_ext, double threshold, int* max1, int* max2);
+
+/* same as above, and also returns in min1, min2 (1 based) where the
+ * alignment ending at max1, max2 starts. if several paths score the same,
+ * the one starting in the last column and then in the last row of s1 is
+ * taken, which is what aligning the reversed prefixes again finds */
+double align_double_local_origin_avx2(ProfileDoubleAVX* profile, const char *s2,
+		int ls2, double gap_open, double gap_ext, double threshold, int* max1,
+		int* max2, int* min1, int* min2);
+double align_double_local_origin_avx512(ProfileDoubleAVX* profile, const char *s2,
+		int ls2, double gap_open, double gap_ext, double threshold, int* max1,
+		int* max2, int* min1, int* min2);
+
+void free_profile_double_avx(ProfileDoubleAVX* profile);
+
+#endif /* DYNPROGR_AVX_DOUBLE_H_ */
@@ -0,0 +1,169 @@
+/** \file DynProgr_avx_short.c
+ *
+ * Profile generation and alignment for packed short vectors on AVX2 and
+ * AVX-512BW. The alignment body lives in DynProgr_avx_short.inc and is
+ * instantiated once per instruction set.
+ */
+
+#include "DynProgr_avx_short.h"
+#include <stdlib.h>
+#include <float.h>
+#include <immintrin.h>
+
+#define VEC_ALIGN 64
+
+static ProfileShortAVX * createProfileShortAVX(const char * query,
+		int queryLen, SMatrix matrix, int lanes) {
+	int segLen = (queryLen + lanes - 1) / lanes;
+	int i, j, k;
+	int16_t * pprofile;
+	size_t vecs = (size_t) segLen * (MATRIX_DIM + 3);
+	ProfileShortAVX * profile = malloc(sizeof(ProfileShortAVX));
+
+	profile->mem = malloc(vecs * lanes * sizeof(int16_t) + VEC_ALIGN);
+	profile->loadOpt = (int16_t *) (((size_t) profile->mem + VEC_ALIGN - 1)
+			& ~(size_t) (VEC_ALIGN - 1));
+	profile->storeOpt = profile->loadOpt + segLen * lanes;
+	profile->rD = profile->storeOpt + segLen * lanes;
+	profile->profile = profile->rD + segLen * lanes;
+
+	profile->len = queryLen;
+	profile->lanes = lanes;
+	profile->segLen = segLen;
+	/* same as the SSE profile, the bias is not used */
+	profile->bias = 0;
+
+	pprofile = profile->profile;
+	for (i = 0; i < MATRIX_DIM; i++) {
+		for (j = 0; j < segLen; j++) {
+			for (k = 0; k < lanes; k++) {
+				if (j + k * segLen < queryLen) {
+					char queryChar = query[j + k * segLen];
+					*(pprofile++) = matrix[queryChar * MATRIX_DIM + i];
+				} else {
+					*(pprofile++) = 0;
+				}
+			}
+		}
+	}
+	return profile;
+}
+
+EXPORT ProfileShortAVX * swps3_createProfileShortAVX2(const char * query,
+		int queryLen, SMatrix matrix) {
+	return createProfileShortAVX(query, queryLen, matrix, 16);
+}
+
+EXPORT ProfileShortAVX * swps3_createProfileShortAVX512(const char * query,
+		int queryLen, SMatrix matrix) {
+	return createProfileShortAVX(query, queryLen, matrix, 32);
+}
+
+EXPORT void swps3_freeProfileShortAVX(ProfileShortAVX * profile) {
+	free(profile->mem);
+	free(profile);
+}
+
+/* AVX2, 16 lanes */
+/******************/
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+static inline __m256i shiftAVX2(__m256i v, __m256i m) {
+	/* low 128 of m below the low 128 of v, then shift everything one lane up */
+	__m256i t = _mm256_permute2x128_si256(v, m, 0x02);
+	return _mm256_alignr_epi8(v, t, 14);
+}
+
+static inline int16_t hmaxAVX2(__m256i v) {
+	__m128i x = _mm_max_epi16(_mm256_castsi256_si128(v),
+			_mm256_extracti128_si256(v, 1));
+	x = _mm_max_epi16(x, _mm_srli_si128(x, 8));
+	x = _mm_max_epi16(x, _mm_srli_si128(x, 4));
+	x = _mm_max_epi16(x, _mm_srli_si128(x, 2));
+	return (int16_t) _mm_extract_epi16(x, 0);
+}
+
+#define VEC __m256i
+#define LANES 16
+#define V_LOAD(p) _mm256_load_si256(p)
+#define V_STORE(p, v) _mm256_store_si256(p, v)
+#define V_SET1(x) _mm256_set1_epi16(x)
+#define V_ADDS(a, b) _mm256_adds_epi16(a, b)
+#define V_SUBS(a, b) _mm256_subs_epi16(a, b)
+#define V_MAX(a, b) _mm256_max_epi16(a, b)
+#define V_SHIFT(v, m) shiftAVX2(v, m)
+#define V_ANY_GT(a, b) _mm256_movemask_epi8(_mm256_cmpgt_epi16(a, b))
+#define V_HMAX(v) hmaxAVX2(v)
+#define NAME(x) x##AVX2
+
+#include "DynProgr_avx_short.inc"
+
+#undef VEC
+#undef LANES
+#undef V_LOAD
+#undef V_STORE
+#undef V_SET1
+#undef V_ADDS
+#undef V_SUBS
+#undef V_MAX
+#undef V_SHIFT
+#undef V_ANY_GT
+#undef V_HMAX
+#undef NAME
+
+#pragma GCC pop_options
+
+/* AVX-512BW, 32 lanes */
+/***********************/
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512bw")
+
+static inline __m512i shiftAVX512(__m512i v, __m512i m) {
+	/* lane 0 from m, lane k from v[k-1] */
+	const __m512i idx = _mm512_set_epi16(
+			62, 61, 60, 59, 58, 57, 56, 55, 54, 53, 52, 51, 50, 49, 48, 47,
+			46, 45, 44, 43, 42, 41, 40, 39, 38, 37, 36, 35, 34, 33, 32, 0);
+	return _mm512_permutex2var_epi16(m, idx, v);
+}
+
+static inline int16_t hmaxAVX512(__m512i v) {
+	__m256i y = _mm256_max_epi16(_mm512_castsi512_si256(v),
+			_mm512_extracti64x4_epi64(v, 1));
+	__m128i x = _mm_max_epi16(_mm256_castsi256_si128(y),
+			_mm256_extracti128_si256(y, 1));
+	x = _mm_max_epi16(x, _mm_srli_si128(x, 8));
+	x = _mm_max_epi16(x, _mm_srli_si128(x, 4));
+	x = _mm_max_epi16(x, _mm_srli_si128(x, 2));
+	return (int16_t) _mm_extract_epi16(x, 0);
+}
+
+#define VEC __m512i
+#define LANES 32
+#define V_LOAD(p) _mm512_load_si512(p)
+#define V_STORE(p, v) _mm512_store_si512(p, v)
+#define V_SET1(x) _mm512_set1_epi16(x)
+#define V_ADDS(a, b) _mm512_adds_epi16(a, b)
+#define V_SUBS(a, b) _mm512_subs_epi16(a, b)
+#define V_MAX(a, b) _mm512_max_epi16(a, b)
+#define V_SHIFT(v, m) shiftAVX512(v, m)
+#define V_ANY_GT(a, b) _mm512_cmpgt_epi16_mask(a, b)
+#define V_HMAX(v) hmaxAVX512(v)
+#define NAME(x) x##AVX512
+
+#include "DynProgr_avx_short.inc"
+
+#undef VEC
+#undef LANES
+#undef V_LOAD
+#undef V_STORE
+#undef V_SET1
+#undef V_ADDS
+#undef V_SUBS
+#undef V_MAX
+#undef V_SHIFT
+#undef V_ANY_GT
+#undef V_HMAX
+#undef NAME
+
+#pragma GCC pop_options
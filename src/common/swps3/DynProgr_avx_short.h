@@ -0,0 +1,37 @@
+/** \file DynProgr_avx_short.h
+ *
+ * Profile generation and alignment for packed short vectors on AVX2 (16 lanes)
+ * and AVX-512BW (32 lanes). Scores are bit-identical to the SSE2 kernel in
+ * DynProgr_sse_short.c, only the number of lanes per instruction differs.
+ *
+ * The kernels are compiled with function level target attributes, so callers
+ * must check the CPU (e.g. __builtin_cpu_supports) before using them.
+ */
+
+#ifndef STRIPED_AVX_SHORT_H
+#define STRIPED_AVX_SHORT_H
+
+#include "swps3.h"
+#include "matrix.h"
+
+typedef struct{
+	int len;
+	int lanes /** 16 for AVX2, 32 for AVX-512BW */;
+	int segLen;
+	uint16_t bias;
+	int16_t * profile;
+	int16_t * rD;
+	int16_t * storeOpt;
+	int16_t * loadOpt;
+	void * mem /** unaligned allocation backing the arrays above */;
+} ProfileShortAVX;
+
+ProfileShortAVX * swps3_createProfileShortAVX2( const char * query, int queryLen, SMatrix matrix );
+double swps3_alignmentShortAVX2( ProfileShortAVX * query, const char * db, int dbLen, Options * options );
+
+ProfileShortAVX * swps3_createProfileShortAVX512( const char * query, int queryLen, SMatrix matrix );
+double swps3_alignmentShortAVX512( ProfileShortAVX * query, const char * db, int dbLen, Options * options );
+
+void swps3_freeProfileShortAVX( ProfileShortAVX * profile );
+
+#endif /* STRIPED_AVX_SHORT_H */
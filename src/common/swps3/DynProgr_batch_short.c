@@ -0,0 +1,82 @@
+/** \file DynProgr_batch_short.c
+ *
+ * Profile generation and inter-sequence alignment of one query against a
+ * batch of targets. The alignment body lives in DynProgr_batch_short.inc and
+ * is instantiated for AVX-512BW.
+ */
+
+#include "DynProgr_batch_short.h"
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <immintrin.h>
+
+#define VEC_ALIGN 64
+
+static ProfileShortBatch * createProfileShortBatch(const char * query,
+		int queryLen, SMatrix matrix, int lanes) {
+	size_t vecs = (size_t) queryLen * 2 + MATRIX_DIM;
+	int i, j;
+	ProfileShortBatch * profile = malloc(sizeof(ProfileShortBatch));
+
+	profile->mem = malloc(vecs * lanes * sizeof(int16_t) + VEC_ALIGN);
+	profile->hArr = (int16_t *) (((size_t) profile->mem + VEC_ALIGN - 1)
+			& ~(size_t) (VEC_ALIGN - 1));
+	profile->eArr = profile->hArr + (size_t) queryLen * lanes;
+	profile->colProfile = profile->eArr + (size_t) queryLen * lanes;
+
+	profile->query = malloc(queryLen + 1);
+	memcpy(profile->query, query, queryLen);
+	profile->query[queryLen] = 0;
+
+	profile->len = queryLen;
+	profile->lanes = lanes;
+	profile->matrix = matrix;
+
+	/* row tables for the lookup kernel, padding scores 0x8000 */
+	for (i = 0; i < MATRIX_DIM; i++)
+		for (j = 0; j < lanes; j++)
+			profile->colProfile[i * lanes + j] = j < MATRIX_DIM ?
+					matrix[i * MATRIX_DIM + j] : (int16_t) 0x8000;
+	return profile;
+}
+
+EXPORT ProfileShortBatch * swps3_createProfileShortBatchAVX512(const char * query,
+		int queryLen, SMatrix matrix) {
+	return createProfileShortBatch(query, queryLen, matrix, 32);
+}
+
+EXPORT void swps3_freeProfileShortBatch(ProfileShortBatch * profile) {
+	free(profile->query);
+	free(profile->mem);
+	free(profile);
+}
+
+/* AVX-512BW, 32 lanes */
+/***********************/
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512bw")
+
+#define VEC __m512i
+#define LANES 32
+#define V_LOAD(p) _mm512_load_si512(p)
+#define V_STORE(p, v) _mm512_store_si512(p, v)
+#define V_SET1(x) _mm512_set1_epi16(x)
+#define V_ADDS(a, b) _mm512_adds_epi16(a, b)
+#define V_MAX(a, b) _mm512_max_epi16(a, b)
+#define V_LOOKUP(i, t) _mm512_permutexvar_epi16(i, t)
+#define NAME(x) x##AVX512
+
+#include "DynProgr_batch_short.inc"
+
+#undef VEC
+#undef LANES
+#undef V_LOAD
+#undef V_STORE
+#undef V_SET1
+#undef V_ADDS
+#undef V_MAX
+#undef V_LOOKUP
+#undef NAME
+
+#pragma GCC pop_options
@@ -0,0 +1,38 @@
+/** \file DynProgr_batch_short.h
+ *
+ * Inter-sequence int16 Smith-Waterman: one query against up to `lanes`
+ * targets at once, every vector lane holding a different target
+ * (Rognes' database layout). This keeps all lanes busy for short proteins,
+ * where the striped kernels spend most of their time in the lazy F loop.
+ *
+ * Per target, scores are bit-identical to swps3_alignmentShortSSE.
+ * Only an AVX-512BW kernel exists, narrower batches lose to the striped
+ * kernels. It is compiled with target attributes, callers must check the
+ * CPU before using it.
+ */
+
+#ifndef BATCH_SHORT_H
+#define BATCH_SHORT_H
+
+#include "swps3.h"
+#include "matrix.h"
+
+typedef struct{
+	int len;
+	int lanes /** 32, AVX-512BW */;
+	char * query /** copy of the query */;
+	SMatrix matrix;
+	int16_t * hArr /** H of the previous column, len vectors */;
+	int16_t * eArr /** row deletion score, len vectors */;
+	int16_t * colProfile /** row tables of the matrix, lanes wide */;
+	void * mem;
+} ProfileShortBatch;
+
+ProfileShortBatch * swps3_createProfileShortBatchAVX512( const char * query, int queryLen, SMatrix matrix );
+
+/* aligns the query against db[0..n), n <= lanes, scores[k] like swps3_alignmentShortSSE */
+void swps3_alignmentShortBatchAVX512( ProfileShortBatch * query, const char * const * db, const int * dbLen, int n, Options * options, double * scores );
+
+void swps3_freeProfileShortBatch( ProfileShortBatch * profile );
+
+#endif /* BATCH_SHORT_H */
@@ -0,0 +1,193 @@
+/** \file DynProgr_diag_short.c
+ *
+ * Anti diagonal int16 local alignment for short pairs on AVX2 and
+ * AVX-512BW. The alignment body lives in DynProgr_diag_short.inc and is
+ * instantiated once per instruction set, the profile is shared.
+ */
+
+#include "DynProgr_diag_short.h"
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <immintrin.h>
+
+#define VEC_ALIGN 64
+/* room past the last row for the lanes of the widest vector */
+#define ROW_PAD 32
+
+static size_t round32(size_t n) {
+	return (n + 31) & ~(size_t) 31;
+}
+
+EXPORT ProfileShortDiag * swps3_createProfileShortDiag(const char * query,
+		int queryLen, SMatrix matrix) {
+	/* +2, the gathers read 32 bits at the last entry */
+	int stride = round32(queryLen + ROW_PAD + 2);
+	size_t row = round32(queryLen + 1 + ROW_PAD);
+	ProfileShortDiag * profile = malloc(sizeof(ProfileShortDiag));
+	int i, c;
+
+	profile->mem = malloc(((size_t) MATRIX_DIM * stride + 7 * row)
+			* sizeof(int16_t) + VEC_ALIGN);
+	profile->table = (int16_t *) (((size_t) profile->mem + VEC_ALIGN - 1)
+			& ~(size_t) (VEC_ALIGN - 1));
+	profile->opt = profile->table + (size_t) MATRIX_DIM * stride;
+	profile->rd = profile->opt + 3 * row;
+	profile->cd = profile->rd + 2 * row;
+	profile->len = queryLen;
+	profile->stride = stride;
+	profile->r2 = NULL;
+	profile->r2_size = 0;
+
+	for (c = 0; c < MATRIX_DIM; c++) {
+		for (i = 0; i < stride; i++) {
+			profile->table[c * stride + i] =
+					i < queryLen ? matrix[query[i] * MATRIX_DIM + c] : 0;
+		}
+	}
+	return profile;
+}
+
+EXPORT void swps3_freeProfileShortDiag(ProfileShortDiag * profile) {
+	free(profile->r2);
+	free(profile->mem);
+	free(profile);
+}
+
+/* the target reversed, each residue times the table stride so it indexes
+ * its row directly, zero padded for the last vector */
+static const int32_t * reverseTarget(ProfileShortDiag * query,
+		const char * db, int dbLen) {
+	int j;
+	if (query->r2_size < dbLen + ROW_PAD) {
+		free(query->r2);
+		query->r2_size = dbLen + ROW_PAD;
+		query->r2 = malloc(query->r2_size * sizeof(int32_t));
+	}
+	for (j = 0; j < dbLen; j++)
+		query->r2[j] = db[dbLen - 1 - j] * query->stride;
+	memset(query->r2 + dbLen, 0, ROW_PAD * sizeof(int32_t));
+	return query->r2;
+}
+
+/* AVX2, 16 lanes */
+/*****************/
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+/* lane k is table[r[k] + i + k] */
+static inline __m256i scoreAVX2(const int16_t * table, const int32_t * r,
+		int i) {
+	const __m256i iota = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	__m256i vI = _mm256_add_epi32(_mm256_set1_epi32(i), iota);
+	__m256i mask = _mm256_set1_epi32(0xffff);
+	__m256i lo, hi;
+	lo = _mm256_add_epi32(_mm256_loadu_si256((const __m256i *) r), vI);
+	hi = _mm256_add_epi32(_mm256_loadu_si256((const __m256i *) (r + 8)),
+			_mm256_add_epi32(vI, _mm256_set1_epi32(8)));
+	/* 32 bit gathers, the upper half is the next entry */
+	lo = _mm256_and_si256(_mm256_i32gather_epi32((const int *) table, lo, 2),
+			mask);
+	hi = _mm256_and_si256(_mm256_i32gather_epi32((const int *) table, hi, 2),
+			mask);
+	/* packus works per 128 bit half, put the halves back in order */
+	return _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xd8);
+}
+
+static inline int16_t hmaxDiagAVX2(__m256i v) {
+	__m128i x = _mm_max_epi16(_mm256_castsi256_si128(v),
+			_mm256_extracti128_si256(v, 1));
+	x = _mm_max_epi16(x, _mm_srli_si128(x, 8));
+	x = _mm_max_epi16(x, _mm_srli_si128(x, 4));
+	x = _mm_max_epi16(x, _mm_srli_si128(x, 2));
+	return (int16_t) _mm_extract_epi16(x, 0);
+}
+
+/* a where lane < n, else b */
+static inline __m256i firstAVX2(__m256i a, __m256i b, int n) {
+	const __m256i iota = _mm256_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10,
+			11, 12, 13, 14, 15);
+	return _mm256_blendv_epi8(b, a,
+			_mm256_cmpgt_epi16(_mm256_set1_epi16(n), iota));
+}
+
+#define VEC __m256i
+#define LANES 16
+#define V_LOADU(p) _mm256_loadu_si256((const __m256i *) (p))
+#define V_STOREU(p, v) _mm256_storeu_si256((__m256i *) (p), v)
+#define V_SET1(x) _mm256_set1_epi16(x)
+#define V_ADDS(a, b) _mm256_adds_epi16(a, b)
+#define V_MAX(a, b) _mm256_max_epi16(a, b)
+#define V_FIRST(a, b, n) firstAVX2(a, b, n)
+#define V_HMAX(v) hmaxDiagAVX2(v)
+#define V_SCORE(t, r, i) scoreAVX2(t, r, i)
+#define NAME(x) x##AVX2
+
+#include "DynProgr_diag_short.inc"
+
+#undef VEC
+#undef LANES
+#undef V_LOADU
+#undef V_STOREU
+#undef V_SET1
+#undef V_ADDS
+#undef V_MAX
+#undef V_FIRST
+#undef V_HMAX
+#undef V_SCORE
+#undef NAME
+
+#pragma GCC pop_options
+
+/* AVX-512BW, 32 lanes */
+/***********************/
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512bw")
+
+/* lane k is table[r[k] + i + k] */
+static inline __m512i scoreAVX512(const int16_t * table, const int32_t * r,
+		int i) {
+	const __m512i iota = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10,
+			11, 12, 13, 14, 15);
+	__m512i vI = _mm512_add_epi32(_mm512_set1_epi32(i), iota);
+	__m512i lo, hi;
+	lo = _mm512_add_epi32(_mm512_loadu_si512(r), vI);
+	hi = _mm512_add_epi32(_mm512_loadu_si512(r + 16),
+			_mm512_add_epi32(vI, _mm512_set1_epi32(16)));
+	/* 32 bit gathers, the truncation drops the next entry */
+	lo = _mm512_i32gather_epi32(lo, table, 2);
+	hi = _mm512_i32gather_epi32(hi, table, 2);
+	return _mm512_inserti64x4(_mm512_castsi256_si512(_mm512_cvtepi32_epi16(lo)),
+			_mm512_cvtepi32_epi16(hi), 1);
+}
+
+#define VEC __m512i
+#define LANES 32
+#define V_LOADU(p) _mm512_loadu_si512(p)
+#define V_STOREU(p, v) _mm512_storeu_si512(p, v)
+#define V_SET1(x) _mm512_set1_epi16(x)
+#define V_ADDS(a, b) _mm512_adds_epi16(a, b)
+#define V_MAX(a, b) _mm512_max_epi16(a, b)
+#define V_FIRST(a, b, n) _mm512_mask_blend_epi16( \
+		(__mmask32) ((n) >= 32 ? ~0u : (1u << (n)) - 1), b, a)
+#define V_HMAX(v) _mm512_reduce_max_epi32( \
+		_mm512_max_epi32(_mm512_srai_epi32(v, 16), \
+				_mm512_srai_epi32(_mm512_slli_epi32(v, 16), 16)))
+#define V_SCORE(t, r, i) scoreAVX512(t, r, i)
+#define NAME(x) x##AVX512
+
+#include "DynProgr_diag_short.inc"
+
+#undef VEC
+#undef LANES
+#undef V_LOADU
+#undef V_STOREU
+#undef V_SET1
+#undef V_ADDS
+#undef V_MAX
+#undef V_FIRST
+#undef V_HMAX
+#undef V_SCORE
+#undef NAME
+
+#pragma GCC pop_options
@@ -0,0 +1,46 @@
+/*
+ * DynProgr_diag_short.h
+ *
+ * int16 local alignment score computed along anti diagonals, for pairs
+ * too short to fill the striped kernels. The cells of a diagonal are
+ * independent, so there is no lazy F loop, and a query shorter than the
+ * vector only leaves lanes idle on the first and last diagonals. Scores
+ * are bit-identical to swps3_alignmentShortSSE (same saturation, DBL_MAX
+ * once the score reaches the int16 limit).
+ *
+ * AVX2 (16 lanes) and AVX-512BW (32 lanes) versions, compiled with target
+ * attributes, callers must check the CPU before using them.
+ */
+
+#ifndef DYNPROGR_DIAG_SHORT_H_
+#define DYNPROGR_DIAG_SHORT_H_
+
+#include <stdint.h>
+#include "swps3.h"
+#include "matrix.h"
+
+typedef struct{
+	int len;
+	/* entries per residue row of table, the query length plus room for the
+	 * lanes of the last vector */
+	int stride;
+	/* table[c * stride + i] = matrix[query[i] * MATRIX_DIM + c] */
+	int16_t * table;
+	/* three diagonals of opt, two of the row and column deletions, indexed
+	 * by the query position */
+	int16_t * opt;
+	int16_t * rd;
+	int16_t * cd;
+	/* the reversed target of the current call times stride, grown as
+	 * needed */
+	int32_t * r2;
+	int r2_size;
+	void * mem /** unaligned allocation backing the arrays above */;
+} ProfileShortDiag;
+
+ProfileShortDiag * swps3_createProfileShortDiag( const char * query, int queryLen, SMatrix matrix );
+double swps3_alignmentShortDiagAVX2( ProfileShortDiag * query, const char * db, int dbLen, Options * options );
+double swps3_alignmentShortDiagAVX512( ProfileShortDiag * query, const char * db, int dbLen, Options * options );
+void swps3_freeProfileShortDiag( ProfileShortDiag * profile );
+
+#endif /* DYNPROGR_DIAG_SHORT_H_ */
@@ -0,0 +1,271 @@
+/** \file DynProgr_global_double.c
+ *
+ * Anti diagonal global alignment with traceback for packed doubles on
+ * SSE2, AVX2 and AVX-512F. The alignment body lives in
+ * DynProgr_global_double.inc and is instantiated once per instruction set,
+ * the arena and the traceback are shared.
+ */
+
+#include "DynProgr_global_double.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <float.h>
+#include <immintrin.h>
+
+#define VEC_ALIGN 64
+/* room past the last row for the lanes of the last vector */
+#define ROW_PAD 16
+
+typedef struct{
+	/* diagonals d, d-1 and d-2, indexed by the row i */
+	double* opt0;
+	double* opt1;
+	double* opt2;
+	double* rd0;
+	double* rd1;
+	double* cd0;
+	double* cd1;
+	/* s1 and s2 reversed, zero padded for the last vector */
+	char* s1;
+	char* r2;
+	/* per vector of cells, bits 0..lanes-1 set where opt came from the row
+	 * deletion, then the column deletion, then where the row and the
+	 * column deletion were extended rather than opened */
+	uint32_t* trace;
+	/* index in trace of the first vector of each diagonal */
+	int* offsets;
+} GlobalDoubleScratch;
+
+static size_t round8(size_t n) {
+	return (n + 7) & ~(size_t) 7;
+}
+
+static size_t traceWords(int ls1, int ls2, int lanes) {
+	return (size_t) ls1 * ls2 / lanes + ls1 + ls2 + 1;
+}
+
+size_t global_double_arena_size(int ls1, int ls2, int lanes) {
+	size_t row = round8(ls1 + 1 + ROW_PAD);
+	return 7 * row * sizeof(double) + traceWords(ls1, ls2, lanes) * sizeof(uint32_t)
+			+ round8(ls1 + ls2 + 2) * sizeof(int) + round8(ls1 + ROW_PAD)
+			+ round8(ls2 + ROW_PAD) + VEC_ALIGN;
+}
+
+static void initGlobalDoubleScratch(GlobalDoubleArena* arena, const char* s1,
+		int ls1, const char* s2, int ls2, int lanes, GlobalDoubleScratch* w) {
+	size_t row = round8(ls1 + 1 + ROW_PAD);
+	size_t size = global_double_arena_size(ls1, ls2, lanes);
+	size_t k;
+	int i;
+
+	if (arena->mem_size < size) {
+		free(arena->mem);
+		arena->mem = malloc(size);
+		arena->mem_size = size;
+	}
+	w->opt0 = (double*) (((size_t) arena->mem + VEC_ALIGN - 1)
+			& ~(size_t) (VEC_ALIGN - 1));
+	w->opt1 = w->opt0 + row;
+	w->opt2 = w->opt1 + row;
+	w->rd0 = w->opt2 + row;
+	w->rd1 = w->rd0 + row;
+	w->cd0 = w->rd1 + row;
+	w->cd1 = w->cd0 + row;
+	w->trace = (uint32_t*) (w->cd1 + row);
+	w->offsets = (int*) (w->trace + traceWords(ls1, ls2, lanes));
+	w->s1 = (char*) (w->offsets + round8(ls1 + ls2 + 2));
+	w->r2 = w->s1 + round8(ls1 + ROW_PAD);
+
+	for (k = 0; k < row; k++) {
+		w->opt0[k] = w->opt1[k] = w->opt2[k] = 0;
+		w->rd0[k] = w->rd1[k] = w->cd0[k] = w->cd1[k] = -DBL_MAX;
+	}
+	memcpy(w->s1, s1, ls1);
+	memset(w->s1 + ls1, 0, ROW_PAD);
+	for (i = 0; i < ls2; i++)
+		w->r2[i] = s2[ls2 - 1 - i];
+	memset(w->r2 + ls2, 0, ROW_PAD);
+}
+
+static int tracebackGlobalDouble(const GlobalDoubleScratch* w, int lanes,
+		const char* s1, int ls1, const char* s2, int ls2, char* o1, char* o2) {
+	/* 0 at an opt cell, 1 in a row deletion, 2 in a column deletion */
+	int i = ls1, j = ls2, len = 0, state = 0;
+	int d, k, bit;
+	uint32_t word;
+	char c;
+
+	/* built backwards */
+	while (i > 0 && j > 0) {
+		d = i + j;
+		k = i - (d - ls2 > 1 ? d - ls2 : 1);
+		word = w->trace[w->offsets[d] + k / lanes];
+		bit = k % lanes;
+		if (state == 0) {
+			if ((word >> (lanes + bit)) & 1)
+				state = 2;
+			else if ((word >> bit) & 1)
+				state = 1;
+			else {
+				o1[len] = s1[--i];
+				o2[len++] = s2[--j];
+			}
+		} else if (state == 1) {
+			o1[len] = '_';
+			o2[len++] = s2[--j];
+			if (!((word >> (2 * lanes + bit)) & 1))
+				state = 0;
+		} else {
+			o1[len] = s1[--i];
+			o2[len++] = '_';
+			if (!((word >> (3 * lanes + bit)) & 1))
+				state = 0;
+		}
+	}
+	while (i > 0) {
+		o1[len] = s1[--i];
+		o2[len++] = '_';
+	}
+	while (j > 0) {
+		o1[len] = '_';
+		o2[len++] = s2[--j];
+	}
+
+	for (k = 0; k < len / 2; k++) {
+		c = o1[k]; o1[k] = o1[len - 1 - k]; o1[len - 1 - k] = c;
+		c = o2[k]; o2[k] = o2[len - 1 - k]; o2[len - 1 - k] = c;
+	}
+	return len;
+}
+
+void free_global_double_arena(GlobalDoubleArena* arena) {
+	free(arena->mem);
+	arena->mem = NULL;
+	arena->mem_size = 0;
+}
+
+/* SSE2, 2 lanes */
+/****************/
+
+static inline __m128d scoreDoubleSSE2(const double* m, const char* a,
+		const char* b) {
+	return _mm_set_pd(m[a[1] * MATRIX_DIM + b[1]], m[a[0] * MATRIX_DIM + b[0]]);
+}
+
+#define VEC __m128d
+#define LANES 2
+#define V_LOADU(p) _mm_loadu_pd(p)
+#define V_STOREU(p, v) _mm_storeu_pd(p, v)
+#define V_SET1(x) _mm_set1_pd(x)
+#define V_ADD(a, b) _mm_add_pd(a, b)
+#define V_MAX(a, b) _mm_max_pd(a, b)
+#define V_MASK_GT(a, b) (uint32_t) _mm_movemask_pd(_mm_cmpgt_pd(a, b))
+#define V_MASK_GE(a, b) (uint32_t) _mm_movemask_pd(_mm_cmpge_pd(a, b))
+#define V_SCORE(m, a, b) scoreDoubleSSE2(m, a, b)
+#define NAME(x) x##_sse2
+
+#include "DynProgr_global_double.inc"
+
+#undef VEC
+#undef LANES
+#undef V_LOADU
+#undef V_STOREU
+#undef V_SET1
+#undef V_ADD
+#undef V_MAX
+#undef V_MASK_GT
+#undef V_MASK_GE
+#undef V_SCORE
+#undef NAME
+
+/* AVX2, 4 lanes */
+/*****************/
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+static inline __m256d scoreDoubleAVX2(const double* m, const char* a,
+		const char* b) {
+	int32_t ia, ib;
+	__m128i idx;
+	memcpy(&ia, a, 4);
+	memcpy(&ib, b, 4);
+	idx = _mm_add_epi32(
+			_mm_mullo_epi32(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(ia)),
+					_mm_set1_epi32(MATRIX_DIM)),
+			_mm_cvtepu8_epi32(_mm_cvtsi32_si128(ib)));
+	return _mm256_i32gather_pd(m, idx, 8);
+}
+
+#define VEC __m256d
+#define LANES 4
+#define V_LOADU(p) _mm256_loadu_pd(p)
+#define V_STOREU(p, v) _mm256_storeu_pd(p, v)
+#define V_SET1(x) _mm256_set1_pd(x)
+#define V_ADD(a, b) _mm256_add_pd(a, b)
+#define V_MAX(a, b) _mm256_max_pd(a, b)
+#define V_MASK_GT(a, b) \
+	(uint32_t) _mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_GT_OQ))
+#define V_MASK_GE(a, b) \
+	(uint32_t) _mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_GE_OQ))
+#define V_SCORE(m, a, b) scoreDoubleAVX2(m, a, b)
+#define NAME(x) x##_avx2
+
+#include "DynProgr_global_double.inc"
+
+#undef VEC
+#undef LANES
+#undef V_LOADU
+#undef V_STOREU
+#undef V_SET1
+#undef V_ADD
+#undef V_MAX
+#undef V_MASK_GT
+#undef V_MASK_GE
+#undef V_SCORE
+#undef NAME
+
+#pragma GCC pop_options
+
+/* AVX-512F, 8 lanes */
+/*********************/
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+
+static inline __m512d scoreDoubleAVX512(const double* m, const char* a,
+		const char* b) {
+	__m256i idx = _mm256_add_epi32(
+			_mm256_mullo_epi32(
+					_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*) a)),
+					_mm256_set1_epi32(MATRIX_DIM)),
+			_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*) b)));
+	return _mm512_i32gather_pd(idx, m, 8);
+}
+
+#define VEC __m512d
+#define LANES 8
+#define V_LOADU(p) _mm512_loadu_pd(p)
+#define V_STOREU(p, v) _mm512_storeu_pd(p, v)
+#define V_SET1(x) _mm512_set1_pd(x)
+#define V_ADD(a, b) _mm512_add_pd(a, b)
+#define V_MAX(a, b) _mm512_max_pd(a, b)
+#define V_MASK_GT(a, b) (uint32_t) _mm512_cmp_pd_mask(a, b, _CMP_GT_OQ)
+#define V_MASK_GE(a, b) (uint32_t) _mm512_cmp_pd_mask(a, b, _CMP_GE_OQ)
+#define V_SCORE(m, a, b) scoreDoubleAVX512(m, a, b)
+#define NAME(x) x##_avx512
+
+#include "DynProgr_global_double.inc"
+
+#undef VEC
+#undef LANES
+#undef V_LOADU
+#undef V_STOREU
+#undef V_SET1
+#undef V_ADD
+#undef V_MAX
+#undef V_MASK_GT
+#undef V_MASK_GE
+#undef V_SCORE
+#undef NAME
+
+#pragma GCC pop_options
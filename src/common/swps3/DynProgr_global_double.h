@@ -0,0 +1,46 @@
+/*
+ * DynProgr_global_double.h
+ *
+ * Double precision global alignment with traceback, computed along anti
+ * diagonals so the cells of one diagonal fill a vector. Same scores and
+ * per cell tie breaks as c_align_double_global, but keeps a bit matrix of
+ * where each cell came from instead of recursing like AlignStrings.
+ *
+ * SSE2 (2 lanes), AVX2 (4 lanes) and AVX-512F (8 lanes) versions. The
+ * AVX ones are compiled with target attributes, callers must check the
+ * CPU before using them.
+ */
+
+#ifndef DYNPROGR_GLOBAL_DOUBLE_H_
+#define DYNPROGR_GLOBAL_DOUBLE_H_
+
+#include <stddef.h>
+#include "swps3.h"
+
+/* scratch memory of the kernels, grown on use and kept between calls.
+ * zero initialize, release with free_global_double_arena */
+typedef struct{
+	void* mem;
+	size_t mem_size;
+} GlobalDoubleArena;
+
+/* bytes of arena an ls1 x ls2 alignment needs with the given lanes, about
+ * half a byte per cell with 8 lanes and two with 2 */
+size_t global_double_arena_size(int ls1, int ls2, int lanes);
+
+/* global alignment of s1 and s2. writes the aligned strings (residues or
+ * '_') to o1 and o2 like AlignStrings, returns their length and the score
+ * in score */
+int align_double_global_sse2(GlobalDoubleArena* arena, const double* matrix,
+		const char* s1, int ls1, const char* s2, int ls2, double gap_open,
+		double gap_ext, char* o1, char* o2, double* score);
+int align_double_global_avx2(GlobalDoubleArena* arena, const double* matrix,
+		const char* s1, int ls1, const char* s2, int ls2, double gap_open,
+		double gap_ext, char* o1, char* o2, double* score);
+int align_double_global_avx512(GlobalDoubleArena* arena, const double* matrix,
+		const char* s1, int ls1, const char* s2, int ls2, double gap_open,
+		double gap_ext, char* o1, char* o2, double* score);
+
+void free_global_double_arena(GlobalDoubleArena* arena);
+
+#endif /* DYNPROGR_GLOBAL_DOUBLE_H_ */
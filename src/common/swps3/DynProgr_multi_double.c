@@ -0,0 +1,88 @@
+/** \file DynProgr_multi_double.c
+ *
+ * Local alignment of one pair under several environments, one per lane.
+ * The alignment body lives in DynProgr_multi_double.inc and is instantiated
+ * for AVX-512F.
+ */
+
+#include "DynProgr_multi_double.h"
+#include <stdlib.h>
+#include <immintrin.h>
+
+#define VEC_ALIGN 64
+
+ProfileDoubleMulti* createProfileDoubleMulti(double** matrices,
+		const double* gap_open, const double* gap_ext, int n, int lanes) {
+	int i, k;
+	size_t size = (MATRIX_DIM * MATRIX_DIM + 2) * lanes * sizeof(double);
+	ProfileDoubleMulti* profile = malloc(sizeof(ProfileDoubleMulti));
+
+	profile->mem = malloc(size + VEC_ALIGN);
+	profile->table = (double*) (((size_t) profile->mem + VEC_ALIGN - 1)
+			& ~(size_t) (VEC_ALIGN - 1));
+	profile->gap_open = profile->table + MATRIX_DIM * MATRIX_DIM * lanes;
+	profile->gap_ext = profile->gap_open + lanes;
+	profile->lanes = lanes;
+	profile->work = NULL;
+	profile->work_size = 0;
+
+	for (k = 0; k < lanes; k++) {
+		int e = k < n ? k : 0;
+		for (i = 0; i < MATRIX_DIM * MATRIX_DIM; i++)
+			profile->table[i * lanes + k] = matrices[e][i];
+		profile->gap_open[k] = gap_open[e];
+		profile->gap_ext[k] = gap_ext[e];
+	}
+	return profile;
+}
+
+void free_profile_double_multi(ProfileDoubleMulti* profile) {
+	free(profile->work);
+	free(profile->mem);
+	free(profile);
+}
+
+/* per row scratch for ls1 rows, opt, row deletion and their origins */
+static double* multiWork(ProfileDoubleMulti* profile, int ls1) {
+	size_t size = (size_t) ls1 * 4 * profile->lanes * sizeof(double)
+			+ VEC_ALIGN;
+	if (profile->work_size < size) {
+		free(profile->work);
+		profile->work = malloc(size);
+		profile->work_size = size;
+	}
+	return (double*) (((size_t) profile->work + VEC_ALIGN - 1)
+			& ~(size_t) (VEC_ALIGN - 1));
+}
+
+/* AVX-512F, 8 lanes */
+/*********************/
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+
+#define VEC __m512d
+#define LANES 8
+#define V_LOAD(p) _mm512_load_pd(p)
+#define V_STORE(p, v) _mm512_store_pd(p, v)
+#define V_SET1(x) _mm512_set1_pd(x)
+#define V_ZERO() _mm512_setzero_pd()
+#define V_ADD(a, b) _mm512_add_pd(a, b)
+#define V_MAX(a, b) _mm512_max_pd(a, b)
+#define V_SEL_GT(a, b, x, y) \
+	_mm512_mask_blend_pd(_mm512_cmp_pd_mask(a, b, _CMP_GT_OQ), y, x)
+#define NAME(x) x##_avx512
+
+#include "DynProgr_multi_double.inc"
+
+#undef VEC
+#undef LANES
+#undef V_LOAD
+#undef V_STORE
+#undef V_SET1
+#undef V_ZERO
+#undef V_ADD
+#undef V_MAX
+#undef V_SEL_GT
+#undef NAME
+
+#pragma GCC pop_options
@@ -0,0 +1,49 @@
+/*
+ * DynProgr_multi_double.h
+ *
+ * Double precision local alignment of one pair of sequences under several
+ * scoring environments at once, one environment per lane, 8 on AVX-512F.
+ * Each lane gives the same score and positions as
+ * align_double_local_origin_avx2 would with that lane's matrix and gaps.
+ * With 4 AVX2 lanes this only breaks even with the single environment
+ * kernels, so there is no AVX2 version.
+ *
+ * The kernel is compiled with target attributes, callers must check
+ * the CPU before using it.
+ */
+
+#ifndef DYNPROGR_MULTI_DOUBLE_H_
+#define DYNPROGR_MULTI_DOUBLE_H_
+
+#include <stddef.h>
+#include "swps3.h"
+
+typedef struct{
+	int lanes;
+	/* MATRIX_DIM * MATRIX_DIM vectors, the scores of each pair of symbols
+	 * in the different lanes */
+	double* table;
+	double* gap_open;
+	double* gap_ext;
+	/* per row of s1: opt and row deletion scores and their origins */
+	double* work;
+	size_t work_size;
+	void* mem;
+} ProfileDoubleMulti;
+
+/* matrices, gap_open and gap_ext hold n <= lanes environments, lanes past
+ * n repeat the first one */
+ProfileDoubleMulti* createProfileDoubleMulti(double** matrices,
+		const double* gap_open, const double* gap_ext, int n, int lanes);
+
+/* aligns s1 against s2 under all the environments of profile, lane k of
+ * the results is for environment k. positions are 1 based, min1, min2 is
+ * where the alignment ending at max1, max2 starts, see
+ * align_double_local_origin_avx2 for how ties are resolved */
+void align_double_local_multi_avx512(ProfileDoubleMulti* profile,
+		const char* s1, int ls1, const char* s2, int ls2, double* scores,
+		int* max1, int* max2, int* min1, int* min2);
+
+void free_profile_double_multi(ProfileDoubleMulti* profile);
+
+#endif /* DYNPROGR_MULTI_DOUBLE_H_ */
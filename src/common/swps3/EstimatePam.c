@@ -2,7 +2,9 @@
 #include <stdio.h>
 #include "EstimatePam.h"
 #include <float.h>
+#include <stdlib.h>
 #include <string.h>
+#include <immintrin.h>
 
 /*
  #  compute the best Pam index for a given
@@ -168,63 +170,116 @@ static void mexp(double *x2k, double *t, double *c, double *r, int n)
 	}
 }
 
+#define VEC_ALIGN 64
+
+/* SSE2, 2 lanes */
+#define VEC __m128d
+#define LANES 2
+#define V_LOAD(p) _mm_load_pd(p)
+#define V_STORE(p, v) _mm_store_pd(p, v)
+#define V_ADD(a, b) _mm_add_pd(a, b)
+#define NAME(x) x##SSE2
+
+#include "EstimatePam.inc"
+
+#undef VEC
+#undef LANES
+#undef V_LOAD
+#undef V_STORE
+#undef V_ADD
+#undef NAME
+
+/* AVX2, 4 lanes */
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+#define VEC __m256d
+#define LANES 4
+#define V_LOAD(p) _mm256_load_pd(p)
+#define V_STORE(p, v) _mm256_store_pd(p, v)
+#define V_ADD(a, b) _mm256_add_pd(a, b)
+#define NAME(x) x##AVX2
+
+#include "EstimatePam.inc"
+
+#undef VEC
+#undef LANES
+#undef V_LOAD
+#undef V_STORE
+#undef V_ADD
+#undef NAME
+
+#pragma GCC pop_options
+
+/* AVX-512F, 8 lanes */
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+
+#define VEC __m512d
+#define LANES 8
+#define V_LOAD(p) _mm512_load_pd(p)
+#define V_STORE(p, v) _mm512_store_pd(p, v)
+#define V_ADD(a, b) _mm512_add_pd(a, b)
+#define NAME(x) x##AVX512
+
+#include "EstimatePam.inc"
+
+#undef VEC
+#undef LANES
+#undef V_LOAD
+#undef V_STORE
+#undef V_ADD
+#undef NAME
+
+#pragma GCC pop_options
+
+/* fills cnt->scores with the score of the counted alignment under every
+ * DayMatrix of table */
+static void ScoreAll(const DayMatrixTable* table, Counters* cnt) {
+	int i;
+	for (i = 0; i < table->stride; i++)
+		cnt->scores[i] = cnt->delF * table->FixedDel[i]
+				+ cnt->delI * table->IncDel[i];
+	if (table->lanes == 8)
+		scoreDayMatricesAVX512(table, cnt);
+	else if (table->lanes == 4)
+		scoreDayMatricesAVX2(table, cnt);
+	else
+		scoreDayMatricesSSE2(table, cnt);
+}
+
 /* a deletion in both sequences (like in an MSA, forced by some other
- insertion) has to be completely eliminated			*/
+ insertion) has to be completely eliminated. the scores of all DMS were
+ computed up front by ScoreAll */
 double ComputeScore(int idms, Counters *cnt, DayMatrix *DMS) {
-	int i;
-	double cj, *Simp;
-	/*if (ISNULL(DMS[idms]->DelCost))*/
-	cj = cnt->delF * DMS[idms].FixedDel + cnt->delI * DMS[idms].IncDel;
-	/*else
-	 for (cj = i = 0; cnt->delL[i] > 0; i++)
-	 cj += ((cnt->delL[i] <= DELCOSTARRAYSIZE) ?
-	 D(DMS[idms]->DelCostArray, cnt->delL[i]) :
-	 DBL(
-	 eval(
-	 New4(FUNCTION, DMS[idms]->DelCost,
-	 Newint(cnt->delL[i]),
-	 NewNumber(DMS[idms]->PamNumber)))));*/
-	Simp = DMS[idms].Simi;
-	for (i = cnt->ninds - 1; i >= 0; i--)
-		cj += Simp[cnt->inds[i]];
-	return (cj);
+	return cnt->scores[idms - 1];
 }
 
 /* On a failure of finding the maximum, consider enlarging MAXPOINTS */
 int FindMaxPamR(int x[], double f[], int n, double *res, Counters *cnt,
 		DayMatrix *DMS);
 
-static void FindMaxPam(char *o1, char *o2, int len, DayMatrix *DMS, int DMSLen,
-		Counters *cnt, int *dmsnumb, double *sim) {
+static void FindMaxPam(char *o1, char *o2, int len, DayMatrix *DMS,
+		DayMatrixTable *table, int DMSLen, Counters *cnt, int *dmsnumb,
+		double *sim) {
 	double f[3 * MAXPOINTS + 1];
-	int i, j, ind, k, x[3 * MAXPOINTS + 1], l;
+	int i, ind, k, x[3 * MAXPOINTS + 1];
 
-	/*if (len >= MAXSEQLEN + 20000)
-	 userror("molecular sequence too long");*/
+	/* the lengths of the deletions (delL) are not kept, nothing reads them */
 	cnt->delF = cnt->delI = cnt->ninds = 0;
-	for (ind = i = j = l = 0; i < len; i++) {
+	for (ind = i = 0; i < len; i++) {
 		if (o1[i] == '_') {
 			if (o2[i] == '_')
 				continue; /* do not count del==del */
-			if (ind == 2) {
-				cnt->delL[j++] = l + 1;
-				l = 0;
-			}
 			if (ind == 1) {
 				cnt->delI++;
-				l++;
 			} else {
 				cnt->delF++;
 				ind = 1;
 			}
 		} else if (o2[i] == '_') {
-			if (ind == 1) {
-				cnt->delL[j++] = l + 1;
-				l = 0;
-			}
 			if (ind == 2) {
 				cnt->delI++;
-				l++;
 			} else {
 				cnt->delF++;
 				ind = 2;
@@ -233,17 +288,10 @@ static void FindMaxPam(char *o1, char *o2, int len, DayMatrix *DMS, int DMSLen,
 			if (/*DMS[1]->Mapping != 0 ||*/(o1[i] != 'X' && o2[i] != 'X'))
 				cnt->inds[cnt->ninds++] = /*MapSymbol(o1[i], DMS[1])*/o1[i]
 						* MATRIX_DIM + /*MapSymbol(o2[i], DMS[1])*/o2[i];
-			if (ind != 0) {
-				cnt->delL[j++] = l + 1;
-				ind = l = 0;
-			}
+			ind = 0;
 		}
-		/*if (j >= MAXSEQLEN / 10)
-		 userror("too many deletions for EstimatePam");*/
 	}
-	if (ind != 0)
-		cnt->delL[j++] = l + 1;
-	cnt->delL[j] = 0;
+	ScoreAll(table, cnt);
 
 	for (k = 0; k <= 3 * MAXPOINTS; k++) {
 		x[k] = k * (DMSLen - 2) / (3 * MAXPOINTS) + 1;
@@ -330,10 +378,12 @@ int FindMaxPamR(int x[], double f[], int n, double *res, Counters *cnt,
 static void ComputeVarianceML(Counters *cnt, int dmsnumb, DayMatrix *DMS,
 		int DMSLen, double *Sim, double *PamNumber, double *PamVariance,
 		double* logPAM1) {
-	double /*logPAM1[MAXMUTDIM * MAXMUTDIM],*/Mp[MAXMUTDIM * MAXMUTDIM],
-			logMp[MAXMUTDIM * MAXMUTDIM], log2Mp[MAXMUTDIM * MAXMUTDIM],
-			t1[MAXMUTDIM * MAXMUTDIM], t2[MAXMUTDIM * MAXMUTDIM], t3[MAXMUTDIM
-					* MAXMUTDIM], t4[MAXMUTDIM * MAXMUTDIM];
+	/* n is always MATRIX_DIM below, MAXMUTDIM sized matrices took 1MB of
+	 stack */
+	double /*logPAM1[MAXMUTDIM * MAXMUTDIM],*/Mp[MATRIX_DIM * MATRIX_DIM],
+			logMp[MATRIX_DIM * MATRIX_DIM], log2Mp[MATRIX_DIM * MATRIX_DIM],
+			t1[MATRIX_DIM * MATRIX_DIM], t2[MATRIX_DIM * MATRIX_DIM], t3[MATRIX_DIM
+					* MATRIX_DIM], t4[MATRIX_DIM * MATRIX_DIM];
 	double /*cj,*/FD1d, logL1, logL2, p, incr, x1;
 	int f21, i, iter, j, n, n2;
 	/*ALGEB s;
@@ -485,8 +535,8 @@ static void ComputeVarianceML(Counters *cnt, int dmsnumb, DayMatrix *DMS,
 static void ComputeSmallVariance(Counters *cnt, int dmsnumb, DayMatrix *DMS,
 		double *Sim, double *PamNumber, double *PamVariance, double* logPAM1) {
 	double a1, a2, b0, t1, t2, t3, t4, t5, ave, var;
-	double /*L1[MAXMUTDIM * MAXMUTDIM],*/L2[MAXMUTDIM * MAXMUTDIM], L3[MAXMUTDIM
-			* MAXMUTDIM];
+	double /*L1[MAXMUTDIM * MAXMUTDIM],*/L2[MATRIX_DIM * MATRIX_DIM], L3[MATRIX_DIM
+			* MATRIX_DIM];
 	int i, ij, n;
 	double* L1 = logPAM1;
 	/*ALGEB p;*/
@@ -555,13 +605,25 @@ static void ComputeSmallVariance(Counters *cnt, int dmsnumb, DayMatrix *DMS,
 	*Sim = ComputeScore(dmsnumb, cnt, DMS);
 }
 
-void EstimatePam(char* o1, char* o2, int len, DayMatrix* DMS, int DMSLen,
-		double* logPAM1, double* result)
+void EstimatePam(char* o1, char* o2, int len, DayMatrix* DMS,
+		DayMatrixTable* table, int DMSLen, double* logPAM1, PamScratch* scratch,
+		double* result)
 
 {
 	Counters cnt;
 	int dmsnumb;
 	double Sim, PamNumber, PamVariance;
+	size_t size = table->stride * sizeof(double) + len * sizeof(int)
+			+ VEC_ALIGN;
+
+	if (scratch->mem_size < size) {
+		free(scratch->mem);
+		scratch->mem = malloc(size);
+		scratch->mem_size = size;
+	}
+	cnt.scores = (double*) (((size_t) scratch->mem + VEC_ALIGN - 1)
+			& ~(size_t) (VEC_ALIGN - 1));
+	cnt.inds = (int*) (cnt.scores + table->stride);
 
 	/* Increase the length to be compatible with the core */
 	DMSLen += 1;
@@ -574,7 +636,7 @@ void EstimatePam(char* o1, char* o2, int len, DayMatrix* DMS, int DMSLen,
 	 New4(EXPSEQ, Newint(0), Newint(250),
 	 Newint(62500))));*/
 	/*DMS = (DayMatrix**) (t[3][1]);*/
-	FindMaxPam(o1, o2, len, DMS, DMSLen, &cnt, &dmsnumb, &Sim);
+	FindMaxPam(o1, o2, len, DMS, table, DMSLen, &cnt, &dmsnumb, &Sim);
 	if (dmsnumb <= 1) {
 		ComputeSmallVariance(&cnt, dmsnumb, DMS, &Sim, &PamNumber, &PamVariance,
 				logPAM1);
@@ -624,6 +686,38 @@ DayMatrix* createDayMatrices(double* gapOpen, double* gapExt,
 	return ret;
 }
 
+DayMatrixTable* createDayMatrixTable(DayMatrix* DMS, int DMSLen) {
+	DayMatrixTable* table = malloc(sizeof(DayMatrixTable));
+	int stride = (DMSLen + 7) & ~7;
+	int i, k;
+
+	table->stride = stride;
+	table->mem = malloc((MATRIX_DIM * MATRIX_DIM + 2) * stride * sizeof(double)
+			+ VEC_ALIGN);
+	table->Simi = (double*) (((size_t) table->mem + VEC_ALIGN - 1)
+			& ~(size_t) (VEC_ALIGN - 1));
+	table->FixedDel = table->Simi + MATRIX_DIM * MATRIX_DIM * stride;
+	table->IncDel = table->FixedDel + stride;
+	/* the padding lanes score 0 */
+	memset(table->Simi, 0,
+			(MATRIX_DIM * MATRIX_DIM + 2) * stride * sizeof(double));
+	for (i = 1; i <= DMSLen; i++) {
+		table->FixedDel[i - 1] = DMS[i].FixedDel;
+		table->IncDel[i - 1] = DMS[i].IncDel;
+		for (k = 0; k < MATRIX_DIM * MATRIX_DIM; k++)
+			table->Simi[k * stride + i - 1] = DMS[i].Simi[k];
+	}
+
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		table->lanes = 8;
+	else if (__builtin_cpu_supports("avx2"))
+		table->lanes = 4;
+	else
+		table->lanes = 2;
+	return table;
+}
+
 void freeDayMatrices(DayMatrix* DMS, int DMSLen) {
 	int i;
 	for (i = 1; i <= DMSLen; ++i) {
@@ -632,6 +726,17 @@ void freeDayMatrices(DayMatrix* DMS, int DMSLen) {
 	free(DMS);
 }
 
+void freeDayMatrixTable(DayMatrixTable* table) {
+	free(table->mem);
+	free(table);
+}
+
+void freePamScratch(PamScratch* scratch) {
+	free(scratch->mem);
+	scratch->mem = NULL;
+	scratch->mem_size = 0;
+}
+
 void CreateOrigDayMatrix(double* log_pam1, double PamNum, double* new_matrix)
 
 /*  Computations following the paper:
@@ -13,10 +13,10 @@
 #include "DynProgr_sse_byte.h"
 #include "DynProgr_sse_short.h"
 
-#define MAXSEQLEN 100010
 #define MINUSINF (-999999999)
 #define MAXMUTDIM 130
 #define MMAX(a,b) ((a)>(b)?(a):(b))
+#include <stddef.h>
 #include <stdint.h>
 
 #define MAXPOINTS 7
@@ -24,13 +24,20 @@
 #define RoundDM(x,v) (SCALB(rint(SCALB(x,v)),-v))
 
 typedef struct Counters {
-	int inds[MAXSEQLEN + 20000], /* encoded pair of symbols, indices in Simi */
+	int *inds, /* encoded pair of symbols, indices in Simi */
 	ninds, /* number of entries in inds */
 	delF, /* number of indels */
-	delI, /* number of amino acids deleted - delF */
-	delL[MAXSEQLEN / 10]; /* length of each deletion (ending in 0) */
+	delI; /* number of amino acids deleted - delF */
+	double *scores; /* ComputeScore of every DayMatrix, DMS[i] at i - 1 */
 } Counters;
 
+/* scratch memory of EstimatePam, grown to the alignment length on use and
+ * kept between calls. zero initialize, release with freePamScratch */
+typedef struct PamScratch {
+	void* mem;
+	size_t mem_size;
+} PamScratch;
+
 typedef struct DayMatrix {
 	double PamNumber;
 	double FixedDel;
@@ -39,16 +46,35 @@ typedef struct DayMatrix {
 	double* Simi;
 } DayMatrix;
 
+/* the DayMatrices transposed, entry k of DMS[1..DMSLen] is contiguous at
+ * Simi + k * stride, so an alignment is scored under all of them at once
+ * with SIMD. the deletion costs are laid out the same way */
+typedef struct DayMatrixTable {
+	int stride; /* DMSLen rounded up to 8 */
+	double* FixedDel;
+	double* IncDel;
+	double* Simi;
+	int lanes; /* of the scoring kernel picked for this CPU */
+	void* mem;
+} DayMatrixTable;
+
 extern double NorFre[MAXMUTDIM];
 
 DayMatrix* createDayMatrices(double* gapOpen, double* gapExt,
 		double* pamDistances, long long* matrix_pointers, int DMSLen);
 
-void EstimatePam(char* o1, char* o2, int len, DayMatrix* DMS, int DMSLen,
-		double* logPAM1, double* result);
+DayMatrixTable* createDayMatrixTable(DayMatrix* DMS, int DMSLen);
+
+void EstimatePam(char* o1, char* o2, int len, DayMatrix* DMS,
+		DayMatrixTable* table, int DMSLen, double* logPAM1, PamScratch* scratch,
+		double* result);
 
 void freeDayMatrices(DayMatrix* DMS, int DMSLen);
 
+void freeDayMatrixTable(DayMatrixTable* table);
+
+void freePamScratch(PamScratch* scratch);
+
 void CreateOrigDayMatrix(double* log_pam1, double pam, double* new_matrix);
 
 #endif /* ESTIMATEPAM_H_ */
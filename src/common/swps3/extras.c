@@ -9,5 +9,23 @@
 #include "DynProgr_sse_short.h"
 #include "DynProgr_sse_double.h"
 
-//double coldel[MAXSEQLEN + 1], S[MAXSEQLEN + 1];
+void reserve_bt_data(BTData* data, int len) {
+	if (data->size > len)
+		return;
+	free(data->coldel);
+	free(data->S);
+	free(data->DelFrom);
+	data->size = len + 1;
+	data->coldel = malloc(data->size * sizeof(double));
+	data->S = malloc(data->size * sizeof(double));
+	data->DelFrom = malloc(data->size * sizeof(int));
+}
 
+void free_bt_data(BTData* data) {
+	free(data->coldel);
+	free(data->S);
+	free(data->DelFrom);
+	data->coldel = data->S = NULL;
+	data->DelFrom = NULL;
+	data->size = 0;
+}
@@ -6,17 +6,22 @@
 #include "DynProgr_sse_byte.h"
 #include "DynProgr_sse_short.h"
 
-#define MAXSEQLEN    100010
 #define MINUSINF (-999999999)
 #define MAXMUTDIM       130
 
 #define MMAX(a,b) ((a)>(b)?(a):(b))
 
-//extern double coldel[MAXSEQLEN+1], S[MAXSEQLEN+1];
-//extern int DelFrom[MAXSEQLEN+1];
+/* one dp row of the double aligners, sized to the sequences aligned.
+ * zero initialize, grow with reserve_bt_data before each alignment and
+ * release with free_bt_data */
 typedef struct {
-  double coldel[MAXSEQLEN+1], S[MAXSEQLEN+1];
-  int DelFrom[MAXSEQLEN+1];
+  double *coldel, *S;
+  int *DelFrom;
+  int size; /* entries of each row */
 } BTData;
 
+/* makes the rows hold at least len + 1 entries */
+void reserve_bt_data(BTData* data, int len);
+void free_bt_data(BTData* data);
+
 #endif
@@ -0,0 +1,163 @@
+#include "task_scheduler.h"
+#include <algorithm>
+
+namespace {
+
+// the scheduler whose pool the calling thread is in, and its slot
+thread_local const TaskScheduler* current_scheduler = nullptr;
+thread_local size_t current_slot = 0;
+
+}  // namespace
+
+TaskScheduler::TaskScheduler(size_t num_threads)
+    : deques_(std::max<size_t>(num_threads, 1)) {
+  // the last slot is the waiting thread outside the pool
+  threads_.reserve(deques_.size() - 1);
+  for (size_t i = 0; i + 1 < deques_.size(); i++) {
+    threads_.push_back(std::thread(&TaskScheduler::Worker, this, i));
+  }
+}
+
+TaskScheduler::~TaskScheduler() {
+  mu_.Lock();
+  run_ = false;
+  mu_.Unlock();
+  for (auto& t : threads_) {
+    t.join();
+  }
+}
+
+size_t TaskScheduler::Slot() const {
+  return current_scheduler == this ? current_slot : deques_.size() - 1;
+}
+
+void TaskScheduler::Submit(TaskGroup* group, std::function<void()> task) {
+  const size_t slot = Slot();
+  mu_.Lock();
+  while (group->capacity_ > 0 && group->queued_ >= group->capacity_) {
+    // caller runs, the group is full of queued tasks
+    Task t;
+    if (TakeLocked(slot, group, &t)) {
+      mu_.Unlock();
+      Run(&t);
+      mu_.Lock();
+    }
+  }
+  deques_[slot].push_back(Task{std::move(task), group});
+  group->queued_++;
+  group->pending_++;
+  num_queued_++;
+  if (group->kind_ == TaskGroup::Kind::kLeaf) {
+    num_leaf_queued_++;
+  } else if (group->kind_ == TaskGroup::Kind::kBackground) {
+    num_background_queued_++;
+  }
+  mu_.Unlock();
+}
+
+void TaskScheduler::Wait(TaskGroup* group) {
+  const size_t slot = Slot();
+  mu_.Lock();
+  while (group->pending_ > 0) {
+    Task t;
+    if (TakeLocked(slot, group, &t)) {
+      mu_.Unlock();
+      Run(&t);
+      mu_.Lock();
+    } else {
+      // the rest of the group runs on other threads, it may still submit
+      struct Waiting {
+        const TaskScheduler* scheduler;
+        const TaskGroup* group;
+      } waiting{this, group};
+      mu_.Await(absl::Condition(
+          +[](Waiting* w) {
+            return w->group->pending_ == 0 || w->group->queued_ > 0 ||
+                   w->scheduler->num_leaf_queued_ > 0;
+          },
+          &waiting));
+    }
+  }
+  mu_.Unlock();
+}
+
+size_t TaskScheduler::NumQueued(const TaskGroup* group) {
+  absl::MutexLock l(&mu_);
+  return group->queued_;
+}
+
+bool TaskScheduler::TakeLocked(size_t slot, const TaskGroup* group,
+                               Task* task) {
+  if (group) {
+    auto of_group = [group](const Task& t) { return t.group == group; };
+    auto leaf = [](const Task& t) {
+      return t.group->kind_ == TaskGroup::Kind::kLeaf;
+    };
+    return (group->queued_ > 0 && TakeIfLocked(slot, of_group, task)) ||
+           (num_leaf_queued_ > 0 && TakeIfLocked(slot, leaf, task));
+  }
+  if (num_queued_ == 0) {
+    return false;
+  }
+  const bool background = num_queued_ == num_background_queued_;
+  auto any = [background](const Task& t) {
+    return background || t.group->kind_ != TaskGroup::Kind::kBackground;
+  };
+  return TakeIfLocked(slot, any, task);
+}
+
+template <typename Wanted>
+bool TaskScheduler::TakeIfLocked(size_t slot, Wanted wanted, Task* task) {
+  for (size_t i = 0; i < deques_.size(); i++) {
+    auto& deque = deques_[(slot + i) % deques_.size()];
+    if (i == 0) {
+      auto it = std::find_if(deque.begin(), deque.end(), wanted);
+      if (it == deque.end()) {
+        continue;
+      }
+      *task = std::move(*it);
+      deque.erase(it);
+    } else {
+      auto it = std::find_if(deque.rbegin(), deque.rend(), wanted);
+      if (it == deque.rend()) {
+        continue;
+      }
+      *task = std::move(*it);
+      deque.erase(std::next(it).base());
+    }
+    task->group->queued_--;
+    num_queued_--;
+    if (task->group->kind_ == TaskGroup::Kind::kLeaf) {
+      num_leaf_queued_--;
+    } else if (task->group->kind_ == TaskGroup::Kind::kBackground) {
+      num_background_queued_--;
+    }
+    return true;
+  }
+  return false;
+}
+
+void TaskScheduler::Run(Task* task) {
+  task->fn();
+  absl::MutexLock l(&mu_);
+  task->group->pending_--;
+}
+
+void TaskScheduler::Worker(size_t slot) {
+  current_scheduler = this;
+  current_slot = slot;
+
+  while (true) {
+    mu_.LockWhen(absl::Condition(
+        +[](TaskScheduler* s) { return s->num_queued_ > 0 || !s->run_; },
+        this));
+    Task t;
+    if (!TakeLocked(slot, nullptr, &t)) {
+      // nothing queued, not running anymore
+      mu_.Unlock();
+      break;
+    }
+    mu_.Unlock();
+    Run(&t);
+  }
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "absl/synchronization/mutex.h"
+
+// work stealing thread pool the cluster, merge and all-all phases of a run
+// all submit to, so the cores stay busy whichever phase has the work.
+// tasks go into a TaskGroup, and a thread waiting for its group (or for
+// room in it) runs the group's queued tasks itself instead of blocking.
+// with none queued it runs tasks of leaf groups, whose tasks never wait,
+// so a wait never nests a task that could wait itself, e.g. a set merge.
+// each thread has a deque. a thread submits into its own, takes the oldest
+// task of its own and steals the newest of another's
+class TaskScheduler {
+ public:
+  // tasks of one phase, e.g. the tiles of one set merge
+  class TaskGroup {
+   public:
+    enum class Kind {
+      kDefault,
+      kLeaf,        // the tasks never wait, any waiting thread may run them
+      kBackground,  // pool threads only take these when nothing else is
+                    // queued, waiting threads not at all
+    };
+
+    // Submit runs tasks of the group while capacity of them are queued,
+    // 0 for no limit
+    explicit TaskGroup(size_t capacity = 0, Kind kind = Kind::kDefault)
+        : capacity_(capacity), kind_(kind) {}
+
+   private:
+    friend class TaskScheduler;
+    const size_t capacity_;
+    const Kind kind_;
+    // protected by the scheduler's mutex
+    size_t queued_ = 0;   // submitted, not taken by a thread yet
+    size_t pending_ = 0;  // submitted, not finished yet
+  };
+
+  // num_threads - 1 pool threads, the thread outside the pool that waits
+  // on a group is the last. only one thread outside the pool may call
+  // Submit or Wait at a time
+  explicit TaskScheduler(size_t num_threads);
+  // all groups must be finished
+  ~TaskScheduler();
+
+  // do not copy or move
+  TaskScheduler(const TaskScheduler& other) = delete;
+  TaskScheduler& operator=(const TaskScheduler& other) = delete;
+
+  void Submit(TaskGroup* group, std::function<void()> task);
+
+  // returns once all tasks submitted to group so far have finished, runs
+  // its tasks and those of leaf groups meanwhile
+  void Wait(TaskGroup* group);
+
+  // tasks queued in group, not running yet
+  size_t NumQueued(const TaskGroup* group);
+
+  size_t NumThreads() const { return deques_.size(); }
+
+  // slot of the calling thread in [0, NumThreads()), for per thread state
+  // of the tasks. a task runs in one slot from start to end, and a slot
+  // runs one task at a time unless the task waits on a group
+  size_t Slot() const;
+
+ private:
+  struct Task {
+    std::function<void()> fn;
+    TaskGroup* group;
+  };
+
+  // a task for slot, the oldest one in its deque, else the newest of the
+  // other deques. of group, else of a leaf group, if group is given, else
+  // of any group, background groups only if nothing else is queued. mu_
+  // must be held
+  bool TakeLocked(size_t slot, const TaskGroup* group, Task* task);
+  // the task of TakeLocked among those wanted(task) is true for
+  template <typename Wanted>
+  bool TakeIfLocked(size_t slot, Wanted wanted, Task* task);
+
+  // runs task, mu_ must not be held
+  void Run(Task* task);
+
+  void Worker(size_t slot);
+
+  absl::Mutex mu_;  // protects the deques, the groups and the below
+  std::vector<std::deque<Task>> deques_;
+  size_t num_queued_ = 0;
+  size_t num_leaf_queued_ = 0;
+  size_t num_background_queued_ = 0;
+  bool run_ = true;
+
+  std::vector<std::thread> threads_;
+};
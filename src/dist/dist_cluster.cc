@@ -13,6 +13,7 @@
 #include "args.h"
 #include "controller.h"
 #include "src/common/alignment_environment.h"
+#include "src/common/kmer_filter.h"
 #include "src/common/params.h"
 #include "src/dataset/load_dataset.h"
 #include "worker.h"
@@ -346,6 +347,72 @@ int main(int argc, char* argv[]) {
     if (blosum_it != aligner_params_json.end()) {
       aligner_params.use_blosum = *blosum_it;
     }
+
+    auto adaptive_pam_search_it =
+        aligner_params_json.find("adaptive_pam_search");
+    if (adaptive_pam_search_it != aligner_params_json.end()) {
+      aligner_params.adaptive_pam_search = *adaptive_pam_search_it;
+    }
+
+    auto refine_band_it = aligner_params_json.find("refine_band");
+    if (refine_band_it != aligner_params_json.end()) {
+      aligner_params.refine_band = *refine_band_it;
+    }
+
+    auto kmer_size_it = aligner_params_json.find("kmer_size");
+    if (kmer_size_it != aligner_params_json.end()) {
+      aligner_params.kmer_size = *kmer_size_it;
+      if (aligner_params.kmer_size < 0 ||
+          aligner_params.kmer_size > KmerFilter::kMaxKmerSize) {
+        std::cerr << "kmer_size must be between 0 and "
+                  << KmerFilter::kMaxKmerSize << ".\n";
+        return 1;
+      }
+    }
+
+    auto kmer_min_hits_it = aligner_params_json.find("kmer_min_hits");
+    if (kmer_min_hits_it != aligner_params_json.end()) {
+      aligner_params.kmer_min_hits = *kmer_min_hits_it;
+      if (aligner_params.kmer_min_hits < 1) {
+        std::cerr << "kmer_min_hits must be at least 1.\n";
+        return 1;
+      }
+    }
+
+    auto ungapped_xdrop_it = aligner_params_json.find("ungapped_xdrop");
+    if (ungapped_xdrop_it != aligner_params_json.end()) {
+      aligner_params.ungapped_xdrop = *ungapped_xdrop_it;
+    }
+
+    auto ungapped_reject_fraction_it =
+        aligner_params_json.find("ungapped_reject_fraction");
+    if (ungapped_reject_fraction_it != aligner_params_json.end()) {
+      aligner_params.ungapped_reject_fraction = *ungapped_reject_fraction_it;
+    }
+
+    auto max_composition_distance_it =
+        aligner_params_json.find("max_composition_distance");
+    if (max_composition_distance_it != aligner_params_json.end()) {
+      aligner_params.max_composition_distance = *max_composition_distance_it;
+    }
+
+    auto pair_cache_mb_it = aligner_params_json.find("pair_cache_mb");
+    if (pair_cache_mb_it != aligner_params_json.end()) {
+      aligner_params.pair_cache_mb = *pair_cache_mb_it;
+    }
+
+    auto float_start_point_it =
+        aligner_params_json.find("float_start_point");
+    if (float_start_point_it != aligner_params_json.end()) {
+      aligner_params.float_start_point = *float_start_point_it;
+    }
+
+    auto kernel_tuning_file_it =
+        aligner_params_json.find("kernel_tuning_file");
+    if (kernel_tuning_file_it != aligner_params_json.end()) {
+      aligner_params.kernel_tuning_file =
+          kernel_tuning_file_it->get<std::string>();
+    }
   }  // if not present, aligner params defaults used
 
   if (is_controller) {
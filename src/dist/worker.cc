@@ -10,6 +10,8 @@
 #include "merge_batch.h"
 #include "src/common/aligner.h"
 #include "src/common/alignment_environment.h"
+#include "src/common/kmer_filter.h"
+#include "src/common/pair_cache.h"
 #include "src/common/params.h"
 
 using std::cout;
@@ -110,13 +112,10 @@ int Worker::ProcessAlignments(const char* seq_buf, ProteinAligner* aligner, Alig
     auto* seq1 = &sequences_[abs_seq_pair->seq1];
     auto* seq2 = &sequences_[abs_seq_pair->seq2];
 
-    if (aligner->LogPamPassesThreshold(seq1->Seq().data(), seq2->Seq().data(),
-                                       seq1->Seq().size(),
-                                       seq2->Seq().size())) {
+    if (aligner->MayPassLogPamThreshold(*seq1, *seq2) &&
+        aligner->LogPamPassesThreshold(*seq1, *seq2)) {
       // auto t0 = std::chrono::high_resolution_clock::now();
-      agd::Status s = aligner->AlignLocal(
-          seq1->Seq().data(), seq2->Seq().data(), seq1->Seq().size(),
-          seq2->Seq().size(), alignment);
+      agd::Status s = aligner->AlignLocal(*seq1, *seq2, alignment);
       /*auto t1 = std::chrono::high_resolution_clock::now();
       auto duration = t1 - t0;
       auto msec =
@@ -219,7 +218,26 @@ agd::Status Worker::Run(const Params& params, const Parameters& aligner_params,
   if (aligner_params.use_blosum) {
     envs.UseBlosum(blosum_json, aligner_params.min_score);
   }
+  for (auto& seq : sequences_) {
+    ProteinAligner::SetScoreBounds(envs, &seq);
+    KmerFilter::SetKmers(aligner_params.kmer_size, &seq);
+  }
+  // shared by the worker threads, alignment requests reuse merge results
+  std::unique_ptr<PairCache> pair_cache;
+  if (aligner_params.pair_cache_mb > 0) {
+    pair_cache.reset(new PairCache(aligner_params.pair_cache_mb));
+  }
   cout << "Done.\n";
+  agd::Status tune_status = ProteinAligner::TuneShortKernels(
+      envs, aligner_params.kernel_tuning_file);
+  if (!tune_status.ok()) {
+    return tune_status;
+  }
+  cout << "Using " << ProteinAligner::ShortKernelName()
+       << " threshold alignment kernel, per length class:\n"
+       << ProteinAligner::ShortKernelTable() << "\n";
+  cout << "Using " << ProteinAligner::DoubleKernelName()
+       << " local alignment kernel.\n";
 
   // done init envs
 
@@ -371,8 +389,8 @@ agd::Status Worker::Run(const Params& params, const Parameters& aligner_params,
     }
   });
 
-  auto worker_func = [this, &envs, &aligner_params]() {
-    ProteinAligner aligner(&envs, &aligner_params);
+  auto worker_func = [this, &envs, &aligner_params, &pair_cache]() {
+    ProteinAligner aligner(&envs, &aligner_params, pair_cache.get());
     // cmproto::MergeRequest request;
     std::deque<ClusterSet> sets_to_merge;
     while (!worker_signal_) {
@@ -9,6 +9,10 @@
 #include "src/common/all_all_executor.h"
 #include "src/common/bottom_up_merge.h"
 #include "src/common/debug.h"
+#include "src/common/kmer_filter.h"
+#include "src/common/pair_cache.h"
+#include "src/common/set_pairing.h"
+#include "src/common/task_scheduler.h"
 
 using std::cout;
 using std::string;
@@ -20,24 +24,31 @@ int main(int argc, char** argv) {
   args::HelpFlag help(parser, "help", "Display this help menu", {'h', "help"});
   args::ValueFlag<unsigned int> threads_arg(
       parser, "threads",
-      absl::StrCat("Number of threads to use for all-all [",
+      absl::StrCat("Number of threads clustering, merging and all-all share [",
                    std::thread::hardware_concurrency(), "]"),
       {'t', "threads"});
   args::ValueFlag<unsigned int> cluster_threads_arg(
       parser, "cluster_threads",
-      absl::StrCat("Number of threads to use for clustering [",
-                   std::thread::hardware_concurrency(), "]"),
-      {'c', "cluster-threads"});
+      "Ignored, clustering uses the -t threads", {'c', "cluster-threads"});
   args::ValueFlag<unsigned int> merge_threads_arg(
-      parser, "merge_threads",
-      absl::StrCat("Number of threads to use for merging [",
-                   std::thread::hardware_concurrency(), "]"),
+      parser, "merge_threads", "Ignored, merging uses the -t threads",
       {'m', "merge-threads"});
   args::ValueFlag<unsigned int> dup_removal_threshold_arg(
       parser, "duplicate removal threshold",
       "How big a set of clusters should be before duplicates are filtered out "
       "[MAX_INT]",
       {'r', "dup_removal_thresh"});
+  args::ValueFlag<std::string> pairing_arg(
+      parser, "pairing",
+      "Which two cluster sets to merge next: fifo (oldest), smallest "
+      "(least clusters) or balanced (cluster counts within max_imbalance) "
+      "[fifo]",
+      {'p', "pairing"});
+  args::ValueFlag<float> max_imbalance_arg(
+      parser, "max_imbalance",
+      "Largest ratio of the cluster counts of two sets balanced pairing "
+      "merges [4]",
+      {"max_imbalance"});
   args::ValueFlag<std::string> json_data_dir(
       parser, "data_dir",
       "Directory containing alignment environment matrices in JSON "
@@ -131,32 +142,32 @@ int main(int argc, char** argv) {
   }
   // cout << "Using " << threads << " hardware threads for alignment.\n";
 
-  unsigned int cluster_threads = std::thread::hardware_concurrency();
-  if (cluster_threads_arg) {
-    cluster_threads = args::get(cluster_threads_arg);
-    // do not allow more than hardware threads
-    if (cluster_threads > std::thread::hardware_concurrency()) {
-      cluster_threads = std::thread::hardware_concurrency();
-    }
+  if (cluster_threads_arg || merge_threads_arg) {
+    cout << "WARNING: ignoring -c and -m, all phases share the " << threads
+         << " -t threads\n";
   }
-  // cout << "Using " << cluster_threads << " hardware threads for
-  // clustering.\n";
-
-  unsigned int merge_threads = std::thread::hardware_concurrency();
-  if (merge_threads_arg) {
-    merge_threads = args::get(merge_threads_arg);
-    // do not allow more than hardware threads
-    if (merge_threads > std::thread::hardware_concurrency()) {
-      merge_threads = std::thread::hardware_concurrency();
-    }
-  }
-  // cout << "Using " << merge_threads << " hardware threads for merging.\n";
 
   uint32_t dup_removal_threshold = UINT_MAX;
   if (dup_removal_threshold_arg) {
     dup_removal_threshold = args::get(dup_removal_threshold_arg);
   }
 
+  SetPairing::Policy pairing = SetPairing::Policy::kFifo;
+  if (pairing_arg &&
+      !SetPairing::ParsePolicy(args::get(pairing_arg), &pairing)) {
+    std::cerr << "Unknown pairing " << args::get(pairing_arg)
+              << ", expected fifo, smallest or balanced.\n";
+    return 1;
+  }
+  float max_imbalance = 4.0f;
+  if (max_imbalance_arg) {
+    max_imbalance = args::get(max_imbalance_arg);
+    if (max_imbalance < 1.0f) {
+      std::cerr << "max_imbalance must be at least 1.\n";
+      return 1;
+    }
+  }
+
   // get output dir to use
   string dir("output_matches");
   if (output_dir) {
@@ -211,6 +222,70 @@ int main(int argc, char** argv) {
     aligner_params.use_blosum = *blosum_it;
   }
 
+  auto adaptive_pam_search_it =
+      aligner_params_json.find("adaptive_pam_search");
+  if (adaptive_pam_search_it != aligner_params_json.end()) {
+    aligner_params.adaptive_pam_search = *adaptive_pam_search_it;
+  }
+
+  auto refine_band_it = aligner_params_json.find("refine_band");
+  if (refine_band_it != aligner_params_json.end()) {
+    aligner_params.refine_band = *refine_band_it;
+  }
+
+  auto kmer_size_it = aligner_params_json.find("kmer_size");
+  if (kmer_size_it != aligner_params_json.end()) {
+    aligner_params.kmer_size = *kmer_size_it;
+    if (aligner_params.kmer_size < 0 ||
+        aligner_params.kmer_size > KmerFilter::kMaxKmerSize) {
+      std::cerr << "kmer_size must be between 0 and "
+                << KmerFilter::kMaxKmerSize << ".\n";
+      return 1;
+    }
+  }
+
+  auto kmer_min_hits_it = aligner_params_json.find("kmer_min_hits");
+  if (kmer_min_hits_it != aligner_params_json.end()) {
+    aligner_params.kmer_min_hits = *kmer_min_hits_it;
+    if (aligner_params.kmer_min_hits < 1) {
+      std::cerr << "kmer_min_hits must be at least 1.\n";
+      return 1;
+    }
+  }
+
+  auto ungapped_xdrop_it = aligner_params_json.find("ungapped_xdrop");
+  if (ungapped_xdrop_it != aligner_params_json.end()) {
+    aligner_params.ungapped_xdrop = *ungapped_xdrop_it;
+  }
+
+  auto ungapped_reject_fraction_it =
+      aligner_params_json.find("ungapped_reject_fraction");
+  if (ungapped_reject_fraction_it != aligner_params_json.end()) {
+    aligner_params.ungapped_reject_fraction = *ungapped_reject_fraction_it;
+  }
+
+  auto max_composition_distance_it =
+      aligner_params_json.find("max_composition_distance");
+  if (max_composition_distance_it != aligner_params_json.end()) {
+    aligner_params.max_composition_distance = *max_composition_distance_it;
+  }
+
+  auto pair_cache_mb_it = aligner_params_json.find("pair_cache_mb");
+  if (pair_cache_mb_it != aligner_params_json.end()) {
+    aligner_params.pair_cache_mb = *pair_cache_mb_it;
+  }
+
+  auto float_start_point_it = aligner_params_json.find("float_start_point");
+  if (float_start_point_it != aligner_params_json.end()) {
+    aligner_params.float_start_point = *float_start_point_it;
+  }
+
+  auto kernel_tuning_file_it = aligner_params_json.find("kernel_tuning_file");
+  if (kernel_tuning_file_it != aligner_params_json.end()) {
+    aligner_params.kernel_tuning_file =
+        kernel_tuning_file_it->get<std::string>();
+  }
+
   // load alignment envs and initialize (this is for SWPS3)
   string json_dir_path = "data/matrices/json/";
   if (json_data_dir) {
@@ -264,6 +339,17 @@ int main(int argc, char** argv) {
     envs.UseBlosum(blosum_json, aligner_params.min_score);
   }
   cout << "Done.\n";
+  agd::Status tune_status = ProteinAligner::TuneShortKernels(
+      envs, aligner_params.kernel_tuning_file);
+  if (!tune_status.ok()) {
+    std::cerr << tune_status.ToString() << "\n";
+    return 1;
+  }
+  cout << "Using " << ProteinAligner::ShortKernelName()
+       << " threshold alignment kernel, per length class:\n"
+       << ProteinAligner::ShortKernelTable() << "\n";
+  cout << "Using " << ProteinAligner::DoubleKernelName()
+       << " local alignment kernel.\n";
 
   // done init envs
 
@@ -291,8 +377,14 @@ int main(int argc, char** argv) {
     return 0;
   }
 
+  // shared by all aligners of the run
+  std::unique_ptr<PairCache> pair_cache;
+  if (aligner_params.pair_cache_mb > 0) {
+    pair_cache.reset(new PairCache(aligner_params.pair_cache_mb));
+  }
+
   // init aligner object
-  ProteinAligner aligner(&envs, &aligner_params);
+  ProteinAligner aligner(&envs, &aligner_params, pair_cache.get());
 
   // build initial clustersets
   // one sequence, in one cluster, in one set
@@ -305,15 +397,19 @@ int main(int argc, char** argv) {
   if (file_name) {
     BottomUpMerge merger(dataset_json_obj, datasets_old, datasets, &aligner);
 
-    AllAllExecutor executor(threads, 1000, &envs, &aligner_params);
-    executor.Initialize();
+    // cluster, merge and all-all tasks all run on these threads
+    TaskScheduler scheduler(threads);
+    AllAllExecutor executor(&scheduler, 1000, &envs, &aligner_params,
+                            pair_cache.get());
 
     auto t0 = std::chrono::high_resolution_clock::now();
-    MergeExecutor merge_executor(merge_threads, 200, &envs, &aligner_params);
+    MergeExecutor merge_executor(&scheduler, 200, &envs, &aligner_params,
+                                 pair_cache.get());
 
     // Add by akash
-    merger.RunMulti(cluster_threads, dup_removal_threshold, &executor,
-                    &merge_executor, !exclude_allall, dataset_file_names);
+    merger.RunMulti(&scheduler, dup_removal_threshold, pairing,
+                    max_imbalance, &executor, &merge_executor,
+                    !exclude_allall, dataset_file_names);
 
     // Call recombine and execute RunMulti again
 
@@ -331,15 +427,19 @@ int main(int argc, char** argv) {
   } else {
     BottomUpMerge merger(datasets, &aligner);
 
-    AllAllExecutor executor(threads, 1000, &envs, &aligner_params);
-    executor.Initialize();
+    // cluster, merge and all-all tasks all run on these threads
+    TaskScheduler scheduler(threads);
+    AllAllExecutor executor(&scheduler, 1000, &envs, &aligner_params,
+                            pair_cache.get());
 
     auto t0 = std::chrono::high_resolution_clock::now();
-    MergeExecutor merge_executor(merge_threads, 200, &envs, &aligner_params);
+    MergeExecutor merge_executor(&scheduler, 200, &envs, &aligner_params,
+                                 pair_cache.get());
 
     // Add by akash
-    merger.RunMulti(cluster_threads, dup_removal_threshold, &executor,
-                    &merge_executor, !exclude_allall, dataset_file_names);
+    merger.RunMulti(&scheduler, dup_removal_threshold, pairing,
+                    max_imbalance, &executor, &merge_executor,
+                    !exclude_allall, dataset_file_names);
 
     // merger.DebugDump();
     // wait and finish call on executor
@@ -352,5 +452,10 @@ int main(int argc, char** argv) {
 
     cout << "Execution time: " << sec.count() << " seconds.\n";
   }
+  if (pair_cache) {
+    cout << "Pair cache: " << pair_cache->NumHits() << " hits, "
+         << pair_cache->NumMisses() << " misses, "
+         << pair_cache->NumEvictions() << " evictions.\n";
+  }
   return (0);
 }